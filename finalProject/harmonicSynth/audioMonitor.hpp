@@ -0,0 +1,215 @@
+// Audio Monitor:
+//
+// Measures how much of its deadline the audio callback uses.
+//
+// - The callback calls begin() and end() around its work. Each block's render time is recorded
+//   as a fraction of the block's duration (its budget) into a histogram of atomic counters and a
+//   lock-free ring, so the audio thread never locks or allocates.
+// - A block that takes longer than its budget is an overrun. A callback that starts much later
+//   than one block after the previous one means the device ran dry, and is counted as late.
+// - The render thread drains the ring for the GUI with recent(), and stats() and dump() read the
+//   histogram at any time, e.g. on exit.
+//
+// StressTest adds sine voices to the callback until the budget is breached, and reports the
+// largest number of voices that was sustained.
+
+#pragma once
+
+#include "oscillatorBank.hpp" // For the stress test's voices.
+#include "spscRing.hpp" // For the recent block times.
+#include <algorithm> // For std::max, std::min.
+#include <atomic> // For the counters.
+#include <chrono> // For timing the callback.
+#include <cstdint> // For the counters.
+#include <cstdio> // For dump().
+#include <vector> // For the stress test's buffers.
+
+class AudioMonitor {
+public:
+  static const int bins = 24; // 5% of the budget per bin, the last bin holds everything from 115% up.
+
+  struct Stats {
+    uint64_t blocks = 0; // Blocks measured.
+    double mean = 0.0, max = 0.0; // Budget used, as a fraction.
+    double p99 = 0.0; // Budget used by 99% of blocks, to the resolution of the histogram.
+    uint64_t overruns = 0; // Blocks over budget.
+    uint64_t late = 0; // Callbacks that started more than one and a half blocks late.
+  };
+
+  // Set the budget from the block size and sample rate:
+  void setup(int blockSize, double sampleRate) {
+    mBudget = blockSize / sampleRate;
+    reset();
+  }
+
+  void reset() {
+    for (auto& count : mHistogram) count = 0;
+    mBlocks = 0;
+    mOverruns = 0;
+    mLate = 0;
+    mTotal = 0;
+    mMax = 0;
+    mStarted = false;
+  }
+
+  double budget() const { return mBudget; }
+
+  // Around the work of each callback. Audio thread only:
+  void begin() {
+    auto now = std::chrono::steady_clock::now();
+    if (mStarted && std::chrono::duration<double>(now - mBegin).count() > 1.5 * mBudget) mLate.fetch_add(1, std::memory_order_relaxed); // The device waited on us.
+    mBegin = now;
+    mStarted = true;
+  }
+
+  void end() {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mBegin).count();
+    float used = float(seconds / mBudget);
+    mLast = used;
+    int bin = std::min(int(used * 20.0f), bins - 1);
+    mHistogram[bin].fetch_add(1, std::memory_order_relaxed);
+    mBlocks.fetch_add(1, std::memory_order_relaxed);
+    if (used > 1.0f) mOverruns.fetch_add(1, std::memory_order_relaxed);
+    mTotal.fetch_add(uint64_t(used * 1e6), std::memory_order_relaxed); // In millionths, to keep an atomic integer sum.
+    uint32_t micro = uint32_t(used * 1e6);
+    if (micro > mMax.load(std::memory_order_relaxed)) mMax.store(micro, std::memory_order_relaxed); // Only the audio thread writes it.
+    mRecent.push(used); // Dropped if the render thread isn't draining.
+  }
+
+  // Budget used by the last block. Audio thread only:
+  float last() const { return mLast; }
+
+  // Mean and peak budget used since the last call. Render thread only:
+  void recent(float& mean, float& peak) {
+    float values[256];
+    size_t count, total = 0;
+    float sum = 0.0f;
+    peak = 0.0f;
+    while ((count = mRecent.pop(values, 256)) > 0) {
+      for (size_t i = 0; i < count; i++) {
+        sum += values[i];
+        peak = std::max(peak, values[i]);
+      }
+      total += count;
+    }
+    mean = total ? sum / total : 0.0f;
+  }
+
+  Stats stats() const {
+    Stats s;
+    s.blocks = mBlocks.load(std::memory_order_relaxed);
+    s.overruns = mOverruns.load(std::memory_order_relaxed);
+    s.late = mLate.load(std::memory_order_relaxed);
+    s.max = mMax.load(std::memory_order_relaxed) * 1e-6;
+    s.mean = s.blocks ? mTotal.load(std::memory_order_relaxed) * 1e-6 / s.blocks : 0.0;
+    uint64_t below = 0;
+    for (int b = 0; b < bins; b++) { // The first bin reaching 99% of the blocks.
+      below += mHistogram[b].load(std::memory_order_relaxed);
+      if (below * 100 >= s.blocks * 99) {
+        s.p99 = (b + 1) * 0.05;
+        break;
+      }
+    }
+    return s;
+  }
+
+  // Print the statistics and the histogram:
+  void dump(FILE* out = stdout) const {
+    Stats s = stats();
+    fprintf(out, "audio callback: %llu blocks, budget %.2f ms, mean %.1f%%, p99 < %.0f%%, max %.1f%%, %llu overruns, %llu late callbacks\n",
+      (unsigned long long)s.blocks, mBudget * 1e3, s.mean * 100.0, s.p99 * 100.0, s.max * 100.0, (unsigned long long)s.overruns, (unsigned long long)s.late);
+    if (!s.blocks) return;
+    for (int b = 0; b < bins; b++) {
+      uint64_t count = mHistogram[b].load(std::memory_order_relaxed);
+      if (!count) continue;
+      int bar = int(60 * count / s.blocks);
+      fprintf(out, "  %3d%%%s %8llu ", b * 5, b == bins - 1 ? "+" : " ", (unsigned long long)count);
+      for (int i = 0; i < bar; i++) fputc('#', out);
+      fputc('\n', out);
+    }
+  }
+
+private:
+  double mBudget = 512.0 / 44100.0; // Seconds per block.
+  std::chrono::steady_clock::time_point mBegin;
+  bool mStarted = false;
+  float mLast = 0.0f;
+  std::atomic<uint64_t> mHistogram[bins];
+  std::atomic<uint64_t> mBlocks{0}, mOverruns{0}, mLate{0}, mTotal{0};
+  std::atomic<uint32_t> mMax{0}; // Largest budget used, in millionths.
+  SpscRing<float, 1024> mRecent; // Budget used by recent blocks.
+};
+
+// Adds voices to the callback until it runs over budget:
+class StressTest {
+public:
+  // Allocate every voice up front, call before audio starts:
+  void setup(int blockSize, double sampleRate, int maxVoices = 16384, float threshold = 0.9f, int settleBlocks = 64) {
+    mBank.setup(maxVoices, blockSize, sampleRate);
+    for (int v = 0; v < maxVoices; v++) {
+      mBank.frequency(v, 110.0f * (1 + v % 24)); // Something for the sines to do.
+      mBank.amplitude(v, 1.0f / (1 + v % 24));
+    }
+    mScratch.assign(blockSize, 0.0f);
+    mThreshold = threshold;
+    mSettle = settleBlocks;
+  }
+
+  // Start from a few voices. Any thread:
+  void start(int voices = 64) {
+    mStartVoices = voices;
+    mSustained = 0;
+    mCapped = false;
+    mFinished = false;
+    mRestart = true;
+  }
+
+  void stop() { mRunning = false; }
+  bool running() const { return mRunning; }
+  bool finished() const { return mFinished; }
+  int sustained() const { return mSustained; } // Most voices that stayed within the threshold.
+  bool capped() const { return mCapped; } // Whether the run ended at the bank's voice limit, still within the threshold.
+  int voices() const { return mVoices; }
+
+  // Render the stress voices and feed back the budget used by the last block. Audio thread only:
+  void process(int frames, float lastUsed) {
+    if (mRestart.exchange(false)) { // Start a new run.
+      mVoices = mStartVoices;
+      mWindowMax = 0.0f;
+      mBlocks = 0;
+      mRunning = true;
+    }
+    if (!mRunning) return;
+    mWindowMax = std::max(mWindowMax, lastUsed);
+    if (++mBlocks >= mSettle) { // After each window...
+      int voices = mVoices;
+      if (mWindowMax < mThreshold) { // Sustained...
+        mSustained = voices;
+        if (voices < mBank.maxVoices()) { // ...add a quarter more voices.
+          mVoices = std::min(mBank.maxVoices(), voices + std::max(1, voices / 4));
+        } else { // ...with every voice there is, the bank's limit rather than the budget's.
+          mCapped = true;
+          mRunning = false;
+          mFinished = true;
+        }
+      } else { // Breached, report the last sustained count.
+        mRunning = false;
+        mFinished = true;
+      }
+      mWindowMax = 0.0f;
+      mBlocks = 0;
+    }
+    mBank.voices(mVoices);
+    mBank.render(frames);
+    std::fill(mScratch.begin(), mScratch.begin() + frames, 0.0f);
+    mBank.mix(mScratch.data(), frames); // Mixed but not played.
+  }
+
+private:
+  OscillatorBank mBank;
+  std::vector<float> mScratch;
+  float mThreshold = 0.9f, mWindowMax = 0.0f;
+  int mSettle = 64, mBlocks = 0, mStartVoices = 64;
+  std::atomic<int> mVoices{0}, mSustained{0};
+  std::atomic<bool> mRunning{false}, mFinished{false}, mRestart{false}, mCapped{false};
+};
@@ -0,0 +1,189 @@
+// Dynamic Resolution:
+//
+// Renders the raymarch pass into an offscreen target at a scaled internal resolution,
+// then reconstructs the full resolution image with a temporal reprojection pass.
+//
+// - The raymarch shader writes the hit distance along the ray into the alpha channel (0 is a miss).
+// - The low resolution image is jittered by a sub-pixel offset each frame.
+// - The resolve pass rebuilds each pixel's world position from the hit distance, projects it
+//   into the previous frame and blends with the history where the previous hit distance agrees.
+// - The history lives in two full resolution textures which are swapped every frame. It holds one
+//   view, so stereo eyes drawn one after the other resolve without it.
+// - The raymarch pass is timed on the GPU with timer queries, which is what the resolution
+//   controller needs: the frame time is capped by vsync, so it can't show that a lower scale has
+//   freed up time. Queries are read a few frames late so the CPU never waits for the GPU.
+
+#pragma once
+
+#include "al/graphics/al_FBO.hpp" // Framebuffer objects.
+#include "al/graphics/al_Graphics.hpp" // Graphics context.
+#include "al/graphics/al_Shader.hpp" // Shader programs.
+#include "al/graphics/al_Texture.hpp" // Textures.
+#include "resolutionController.hpp" // Chooses the internal resolution from the frame time.
+
+// Times a GPU pass, without stalling, by cycling through a few timer queries:
+struct GpuTimer {
+  static const int latency = 4; // Queries in flight, results are read this many frames late at most.
+  GLuint queries[latency] = {};
+  bool pending[latency] = {}; // Whether each query has a result still to read.
+  bool running = false; // Whether a query was started this frame.
+  int next = 0; // The query to start next, also the oldest one in flight.
+  double lastTime = 0.0; // Seconds the last measured pass took on the GPU.
+  bool fresh = false; // Whether lastTime is new since measure() last read it.
+
+  void begin() {
+    if (!queries[0]) glGenQueries(latency, queries); // Created on first use, with a context current.
+    poll();
+    running = !pending[next]; // Skip timing a frame rather than wait for an old result.
+    if (running) glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+  }
+
+  void end() {
+    if (!running) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[next] = true;
+    next = (next + 1) % latency;
+    running = false;
+  }
+
+  // Read the results that are ready, oldest first, freeing their queries. Returns true when there's
+  // a new measurement:
+  bool poll() {
+    bool measured = false;
+    for (int k = 0; k < latency; k++) {
+      int i = (next + k) % latency;
+      if (!pending[i]) continue;
+      GLint available = 0;
+      glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) break; // Later queries finish later.
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+      lastTime = double(nanoseconds) * 1e-9;
+      fresh = true; // Kept for measure(), even when begin() polled it.
+      pending[i] = false;
+      measured = true;
+    }
+    return measured;
+  }
+};
+
+struct TemporalUpsampler {
+  al::FBO lowFbo; // Framebuffer for the scaled raymarch pass.
+  al::Texture lowTex; // Color in rgb, hit distance in alpha.
+  al::FBO historyFbo[2]; // Ping-pong framebuffers for the resolved image.
+  al::Texture historyTex[2]; // Resolved color in rgb, hit distance in alpha.
+  int lowWidth = 0, lowHeight = 0; // Size of the scaled target.
+  int fullWidth = 0, fullHeight = 0; // Size of the output.
+  int current = 0; // Index of the history texture written this frame.
+  int frame = 0; // Frame counter for the jitter sequence.
+  bool historyValid = false; // False until a frame has been resolved at the current size.
+  bool temporal = true; // False resolves each frame on its own, unjittered and without the history.
+  al::Matrix4f prevViewProj; // View projection matrix of the previous frame.
+  al::Vec3f prevCamPos; // Camera position of the previous frame.
+  float historyWeight = 0.85f; // How much of the reprojected history is kept.
+  GpuTimer timer; // Times the scaled raymarch pass, for the resolution controller.
+
+  // Create a color target with a float alpha channel so it can hold the hit distance:
+  static void createTarget(al::FBO& fbo, al::Texture& tex, int w, int h) {
+    tex.create2D(w, h, GL_RGBA32F, GL_RGBA, GL_FLOAT); // Allocate the texture.
+    tex.filter(al::Texture::LINEAR); // Bilinear filtering for upsampling.
+    tex.wrap(al::Texture::CLAMP_TO_EDGE); // Don't wrap around at the borders.
+    fbo.bind(); // Bind the framebuffer.
+    fbo.attachTexture2D(tex); // Render into the texture.
+    fbo.unbind(); // Unbind the framebuffer.
+  }
+
+  // Make sure the render targets match the output size and the chosen scale:
+  void resize(int w, int h, const ResolutionController& controller) {
+    int lw = controller.scaled(w), lh = controller.scaled(h);
+    if (w != fullWidth || h != fullHeight) { // If the output size has changed...
+      fullWidth = w;
+      fullHeight = h;
+      for (int i = 0; i < 2; i++) createTarget(historyFbo[i], historyTex[i], w, h); // Reallocate the history.
+      historyValid = false; // The old history no longer lines up.
+    }
+    if (lw != lowWidth || lh != lowHeight) { // If the scale has changed...
+      lowWidth = lw;
+      lowHeight = lh;
+      createTarget(lowFbo, lowTex, lw, lh); // Reallocate the scaled target.
+    }
+  }
+
+  // Sub-pixel jitter for this frame in normalized device coordinates:
+  al::Vec2f jitter() const {
+    if (!temporal) return al::Vec2f(0, 0);
+    int i = (frame % 8) + 1; // Cycle through eight samples of the Halton sequence.
+    return al::Vec2f((halton(i, 2) - 0.5f) * 2.0f / lowWidth, (halton(i, 3) - 0.5f) * 2.0f / lowHeight);
+  }
+
+  // Begin rendering the raymarch pass into the scaled target:
+  void begin(al::Graphics& g) {
+    g.pushFramebuffer(lowFbo); // Render offscreen.
+    g.pushViewport(0, 0, lowWidth, lowHeight); // At the scaled resolution.
+    g.clear(0, 0, 0, 0); // Clear color and distance.
+    timer.begin(); // Time the pass on the GPU.
+  }
+
+  // Feed the controller the GPU time of the raymarch pass, whenever a new one has been measured.
+  // Returns true when the scale has changed:
+  bool measure(ResolutionController& controller) {
+    timer.poll();
+    if (!timer.fresh) return false;
+    timer.fresh = false;
+    return controller.update(timer.lastTime);
+  }
+
+  // Call on frames drawn without the upsampler, so the history isn't blended in from an old camera
+  // when it's used again:
+  void skip() { historyValid = false; }
+
+  // Whether to keep a history, which needs one view per frame: each eye of a stereo pair
+  // reprojecting the other's image would blend two views, and step the jitter twice a frame:
+  void views(int eye) { temporal = eye == 0; }
+
+  // Finish the raymarch pass:
+  void end(al::Graphics& g) {
+    timer.end();
+    g.popViewport();
+    g.popFramebuffer();
+  }
+
+  // Resolve the scaled image into the history and draw it to the screen.
+  // The resolve shader shares the ray generation of the raymarch vertex shader, so the caller
+  // sets the matrix and lens uniforms on it before calling this.
+  void resolve(al::Graphics& g, al::ShaderProgram& shader, al::VAOMesh& quad, const al::Matrix4f& viewProj, const al::Vec3f& camPos) {
+    int previous = 1 - current; // The history written last frame.
+    g.pushFramebuffer(historyFbo[current]); // Write this frame's history.
+    g.pushViewport(0, 0, fullWidth, fullHeight); // At the full resolution.
+    lowTex.bind(0); // The scaled raymarch image.
+    historyTex[previous].bind(1); // Last frame's resolved image.
+    shader.use();
+    shader.uniform("tex_current", 0)
+    .uniform("tex_history", 1)
+    .uniform("out_size", al::Vec2f(fullWidth, fullHeight))
+    .uniform("low_size", al::Vec2f(lowWidth, lowHeight))
+    .uniform("jitter", al::Vec2f(0, 0)) // The resolve pass itself is not jittered.
+    .uniform("sample_jitter", jitter()) // But the scaled image it reads was.
+    .uniform("history_weight", temporal && historyValid ? historyWeight : 0.0f)
+    .uniform("prev_view_proj", prevViewProj)
+    .uniform("prev_cam_pos", prevCamPos);
+    quad.draw(); // Run the resolve shader over the full screen.
+    historyTex[previous].unbind(1);
+    lowTex.unbind(0);
+    g.popViewport();
+    g.popFramebuffer();
+
+    // Draw the resolved image to the screen:
+    g.pushCamera(al::Viewpoint::IDENTITY); // Draw in normalized device coordinates.
+    g.blending(false); // The alpha channel holds distances, not coverage.
+    g.quad(historyTex[current], -1, -1, 2, 2); // Fullscreen textured quad.
+    g.popCamera();
+
+    // Remember this frame for the next reprojection:
+    prevViewProj = viewProj;
+    prevCamPos = camPos;
+    historyValid = temporal;
+    current = previous; // Swap the history buffers.
+    if (temporal) frame++; // Advance the jitter sequence.
+  }
+};
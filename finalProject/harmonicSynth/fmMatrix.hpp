@@ -0,0 +1,111 @@
+// FM Matrix:
+//
+// Clusters that approach each other frequency modulate one another.
+//
+// - Once per block, a spatial hash finds the pairs of clusters closer than a threshold. Each pair
+//   becomes two entries of a sparse modulation matrix, one in each direction, with an index that
+//   fades in from zero at the threshold, so pairs come and go without clicks.
+// - Each cluster in a pair contributes a sine at its fundamental as the modulator. A carrier's
+//   modulation is the sum of its entries' modulators, one multiply-add loop over the block per entry.
+// - The modulation is applied to the carrier's oscillators as a phase offset, see
+//   OscillatorBank::modulation(). Clusters without neighbours render unmodulated.
+//
+// The cost per block follows the number of pairs, not the square of the number of clusters.
+// Everything is allocated in setup(), nothing allocates on the audio thread.
+
+#pragma once
+
+#include "oscillatorBank.hpp" // For sinCycles.
+#include "spatialHash.hpp" // For finding the pairs.
+#include <algorithm> // For std::fill.
+#include <cmath> // For std::floor.
+#include <vector> // For the buffers.
+
+// One entry of the sparse modulation matrix:
+struct FmEntry {
+  int carrier, modulator; // Clusters.
+  float index; // Peak phase deviation, in cycles.
+};
+
+class FmMatrix {
+public:
+  // Allocate every buffer, call before the audio thread starts:
+  void setup(int maxClusters, int blockSize, double sampleRate, int maxPairs = 256) {
+    mMaxClusters = maxClusters;
+    mBlockSize = blockSize;
+    mSampleRate = sampleRate;
+    mHash.setup(maxClusters, maxPairs);
+    mEntries.reserve(2 * maxPairs);
+    mFrequency.assign(maxClusters, 0.0f);
+    mPhase.assign(maxClusters, 0.0f);
+    mModulating.assign(maxClusters, 0);
+    mCarried.assign(maxClusters, 0);
+    mModulator.assign(size_t(maxClusters) * blockSize, 0.0f);
+    mModulation.assign(size_t(maxClusters) * blockSize, 0.0f);
+  }
+
+  // Set the frequency a cluster modulates its neighbours with:
+  void frequency(int cluster, float hz) { mFrequency[cluster] = hz; }
+
+  // Find the pairs closer than threshold and build the matrix. Positions are x, y, z triples,
+  // amount scales the index of the entries carried by each cluster:
+  void build(const float* positions, const float* amount, int count, float threshold) {
+    mCount = std::min(count, mMaxClusters);
+    mEntries.clear();
+    for (const PointPair& pair : mHash.build(positions, mCount, threshold)) {
+      float fade = 1.0f - pair.distance / threshold; // 0 at the threshold, 1 when touching.
+      fade *= fade;
+      if (amount[pair.a] > 0.0f) mEntries.push_back({pair.a, pair.b, amount[pair.a] * fade}); // b modulates a.
+      if (amount[pair.b] > 0.0f) mEntries.push_back({pair.b, pair.a, amount[pair.b] * fade}); // a modulates b.
+    }
+  }
+
+  // Render the modulation of every carrier for the next block:
+  void render(int frames) {
+    frames = std::min(frames, mBlockSize);
+    std::fill(mModulating.begin(), mModulating.end(), 0);
+    std::fill(mCarried.begin(), mCarried.end(), 0);
+    for (const FmEntry& e : mEntries) {
+      mModulating[e.modulator] = 1;
+      mCarried[e.carrier] = 1;
+    }
+    for (int c = 0; c < mCount; c++) { // For each cluster...
+      float inc = float(mFrequency[c] / mSampleRate);
+      if (mModulating[c]) { // Render its modulator only if a neighbour uses it.
+        float* out = modulator(c);
+        float phase = mPhase[c];
+        for (int i = 0; i < frames; i++) {
+          float p = phase + i * inc;
+          out[i] = sinCycles(p - std::floor(p));
+        }
+      }
+      if (mCarried[c]) std::fill(modulationOf(c), modulationOf(c) + frames, 0.0f);
+      double p = mPhase[c] + double(frames) * inc; // Keep every modulator's phase running, so it is continuous when a pair forms.
+      mPhase[c] = float(p - std::floor(p));
+    }
+    for (const FmEntry& e : mEntries) { // Sparse matrix times the modulators.
+      float* out = modulationOf(e.carrier);
+      const float* in = modulator(e.modulator);
+      for (int i = 0; i < frames; i++) out[i] += e.index * in[i];
+    }
+  }
+
+  // The phase offsets of a cluster's oscillators for the block, in cycles, or nullptr if it isn't modulated:
+  const float* modulation(int cluster) const {
+    return mCarried[cluster] ? &mModulation[size_t(cluster) * mBlockSize] : nullptr;
+  }
+
+  const std::vector<FmEntry>& entries() const { return mEntries; }
+
+private:
+  int mMaxClusters = 0, mBlockSize = 0, mCount = 0;
+  double mSampleRate = 44100.0;
+  SpatialHash mHash;
+  std::vector<FmEntry> mEntries; // The sparse matrix.
+  std::vector<float> mFrequency, mPhase; // Modulator frequencies and phases.
+  std::vector<char> mModulating, mCarried; // Whether each cluster modulates or is modulated this block.
+  std::vector<float> mModulator, mModulation; // One block per cluster.
+
+  float* modulator(int cluster) { return &mModulator[size_t(cluster) * mBlockSize]; }
+  float* modulationOf(int cluster) { return &mModulation[size_t(cluster) * mBlockSize]; }
+};
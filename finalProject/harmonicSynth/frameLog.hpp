@@ -0,0 +1,151 @@
+// Frame Log:
+//
+// Logging and telemetry for the render loop, cheap enough to stay in performance builds.
+//
+// - log() only copies a fixed size binary record into a lock-free ring, it never formats,
+//   locks, allocates or touches stdout. When the ring is full the record is dropped and counted.
+// - Each channel has a rate limit, so logging something every frame doesn't flood the output.
+// - A background thread drains the ring, appends the records to a binary file and
+//   optionally prints them as text.
+//
+// File format, little endian:
+//   header:  "FLOG", uint32 version, uint32 channel count, then for each channel a uint32
+//            name length followed by the name.
+//   records: LogRecord as laid out below (40 bytes), one after another.
+//
+// log() is meant to be called from a single thread (the animation thread).
+
+#pragma once
+
+#include "spscRing.hpp" // The lock-free ring between the logging thread and the writer.
+#include <atomic> // For the stop flag and the drop counter.
+#include <chrono> // For timestamps.
+#include <cstdint> // For fixed size record fields.
+#include <cstdio> // For the log file and printing.
+#include <string> // For channel names.
+#include <thread> // For the writer thread.
+#include <vector> // For the channels.
+
+// A single log entry:
+struct LogRecord {
+  uint64_t time; // Nanoseconds since the log was started.
+  uint32_t channel; // Index of the channel.
+  uint32_t count; // Number of values used.
+  float values[4]; // The logged values.
+  uint32_t frame; // The frame the entry was logged on.
+  uint32_t reserved; // Padding, keeps the record at 40 bytes.
+};
+static_assert(sizeof(LogRecord) == 40, "LogRecord is written to the file as is");
+
+class FrameLog {
+public:
+  bool echo = false; // Print the records as text from the writer thread.
+
+  ~FrameLog() { stop(); }
+
+  // Register a channel before start(), returns its index. maxRate limits the records per second, 0 for no limit:
+  int channel(const std::string& name, double maxRate = 0.0) {
+    Channel c;
+    c.name = name;
+    c.interval = maxRate > 0.0 ? uint64_t(1e9 / maxRate) : 0;
+    mChannels.push_back(c);
+    return int(mChannels.size()) - 1;
+  }
+
+  // Open the log file and start the writer thread. An empty path only echoes:
+  bool start(const std::string& path) {
+    mStart = std::chrono::steady_clock::now();
+    if (!path.empty()) {
+      mFile = fopen(path.c_str(), "wb");
+      if (!mFile) return false;
+      writeHeader();
+    }
+    mRunning = true;
+    mWriter = std::thread([this]() { drain(); });
+    return true;
+  }
+
+  // Flush the remaining records and stop the writer thread:
+  void stop() {
+    if (!mRunning) return;
+    mRunning = false;
+    mWriter.join();
+    if (mFile) fclose(mFile);
+    mFile = nullptr;
+    if (mDropped > 0) printf("frame log: dropped %u records\n", unsigned(mDropped));
+  }
+
+  // Advance the frame counter stamped on the records:
+  void frame() { mFrame++; }
+
+  // Log up to four values on a channel. Never blocks, returns false if rate limited or dropped:
+  bool log(int channel, float a, float b = 0.0f, float c = 0.0f, float d = 0.0f, uint32_t count = 0) {
+    if (!mRunning || channel < 0 || channel >= int(mChannels.size())) return false;
+    uint64_t now = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart).count());
+    Channel& ch = mChannels[channel];
+    if (ch.interval && ch.logged && now - ch.last < ch.interval) return false; // Rate limited.
+    ch.last = now;
+    ch.logged = true;
+    LogRecord record{now, uint32_t(channel), count ? count : 4, {a, b, c, d}, mFrame, 0};
+    if (!mRing.push(record)) { // If the writer has fallen behind...
+      mDropped++; // Drop the record rather than wait.
+      return false;
+    }
+    return true;
+  }
+
+  uint32_t dropped() const { return mDropped; }
+
+private:
+  struct Channel {
+    std::string name;
+    uint64_t interval = 0; // Minimum nanoseconds between records.
+    uint64_t last = 0; // Time of the last record.
+    bool logged = false; // Whether the channel has logged yet.
+  };
+
+  std::vector<Channel> mChannels;
+  SpscRing<LogRecord, 4096> mRing;
+  std::chrono::steady_clock::time_point mStart;
+  std::thread mWriter;
+  std::atomic<bool> mRunning{false};
+  std::atomic<uint32_t> mDropped{0};
+  uint32_t mFrame = 0;
+  FILE* mFile = nullptr;
+
+  void writeHeader() {
+    uint32_t version = 1, count = uint32_t(mChannels.size());
+    fwrite("FLOG", 1, 4, mFile);
+    fwrite(&version, sizeof(version), 1, mFile);
+    fwrite(&count, sizeof(count), 1, mFile);
+    for (const Channel& c : mChannels) {
+      uint32_t length = uint32_t(c.name.size());
+      fwrite(&length, sizeof(length), 1, mFile);
+      fwrite(c.name.data(), 1, length, mFile);
+    }
+  }
+
+  // Writer thread, empties the ring every few milliseconds:
+  void drain() {
+    LogRecord records[256];
+    while (true) {
+      bool running = mRunning; // Read before draining, so the last records are not missed.
+      size_t count;
+      while ((count = mRing.pop(records, 256)) > 0) {
+        if (mFile) fwrite(records, sizeof(LogRecord), count, mFile);
+        if (echo) print(records, count);
+      }
+      if (!running) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  void print(const LogRecord* records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      const LogRecord& r = records[i];
+      printf("[%.3f] %s:", r.time * 1e-9, mChannels[r.channel].name.c_str());
+      for (uint32_t v = 0; v < r.count && v < 4; v++) printf(" %g", r.values[v]);
+      printf("\n");
+    }
+  }
+};
@@ -34,6 +34,18 @@
 #include "al/ui/al_ParameterGUI.hpp" // Parameters to GUI.
 #include "al_ext/statedistribution/al_CuttleboneDomain.hpp" // For distributing state across multiple machines in AlloSphere.
 #include "al_ext/statedistribution/al_CuttleboneStateSimulationDomain.hpp"
+#include "dynamicResolution.hpp" // Scaled raymarch pass with temporal upsampling.
+#include "sceneSdf.hpp" // CPU versions of the shader's distance functions.
+#include "sdfVolume.hpp" // Distance fields baked into 3D textures.
+#include "stereoTracer.hpp" // CPU reference of the raymarch, for checking single pass stereo.
+#include "shaderWatcher.hpp" // Shader hot reloading off the render thread.
+#include "frameLog.hpp" // Lock-free logging from the render loop.
+#include "synthEngine.hpp" // The audio graph, shared by the audio callback and offline renders.
+#include "wavWriter.hpp" // For offline renders.
+#include "audioMonitor.hpp" // Deadline monitoring of the audio callback.
+#include "latentDecoder.hpp" // Parameter states from the grid controller.
+#include "morphScheduler.hpp" // Eased transitions between parameter states.
+#include <future> // For writing offline renders while the next chunk renders.
 
 using namespace al;
 
@@ -48,22 +60,65 @@ struct RayApp : public DistributedAppWithState<State> {
   Nav cluster1; // Navs for the clusters.
   Nav meta1, meta2, meta3, meta4, meta5, meta6, meta7, meta8; // Navs for the metaballs.
   VAOMesh quad; // A fullscreen quad mesh for which to color with our shader.
-  ShaderProgram clusters; // The raymarched shader program.
+  ShaderSlot clusters; // The raymarched shader program.
+  ShaderSlot upsample; // Temporal upsampling of the scaled raymarch pass.
+  ResolutionController resolution; // Chooses the internal resolution from the frame time.
+  TemporalUpsampler upsampler; // Render targets and history for dynamic resolution.
+  MetaballCluster clusterShape; // The static arrangement of metaballs within a cluster.
+  SdfBakeCache sdfCache; // Baked distance volumes keyed by the cluster shape.
+  Texture sdfTexture; // The baked distance volume of the cluster.
+  const int sdfResolution = 64; // Voxels along each axis of the baked volume.
+  ShaderSlot clustersStereo; // Traces both eyes in one pass.
+  FBO stereoFbo; // Framebuffer with one color attachment per eye.
+  Texture stereoTex[2]; // The left and right eye images of the single pass.
+  int stereoWidth = 0, stereoHeight = 0; // Size of the stereo targets.
   float timer = 0;
+  FrameLog frameLog; // Logging which never blocks the animation thread.
+  int clusterChannel; // Log channel for the cluster position.
+  SynthEngine synth; // The audio graph.
+  std::vector<float*> outputBlocks; // The output buffers of the audio callback.
+  AudioMonitor audioMonitor; // How much of its deadline the audio callback uses.
+  StressTest stressTest; // Adds voices to the callback until it runs over budget.
+  bool stressStarted = false; // Whether a stress test was started from the GUI.
+  MlpDecoder latentDecoder; // Decodes grid positions into parameter states.
+  GridCache latentGrid; // The decoded state at every grid point.
+  std::vector<Parameter*> latentTargets; // The parameters driven by the decoder, in the order of its outputs.
+  std::vector<float> latentState; // The blended state, from 0 to 1 per parameter.
+  MorphScheduler gridMorph; // Moves the parameters to each new grid state over the morph time.
+  float lastGridX = -1.0f, lastGridY = -1.0f; // The grid position last applied.
+  float oscillationPhase[numClusters] = {}; // Phase of each cluster's oscillation, in radians.
+  float clusterScale[numClusters]; // Size of each cluster, passed to the shader.
     
   // Watch for changes in the shader file and reload.
   SearchPaths searchPaths; // A search path for shader files.
-  struct WatchedFile { 
-    File file; // The file to watch.
-    al_sec modified; // The last time the file was modified.
-  };
-  std::map<std::string, WatchedFile> watchedFiles; // A map of watched files.
-  al_sec watchCheckTime; // The last time the files were checked for modification.
+  ShaderWatcher shaderWatcher; // Watches the shader files on its own thread, declared after the programs so it stops first.
 
   // GUI Parameters:
   ControlGUI *gui; // GUI for controlling uniform parameters.
+  ParameterBool dynamicRes{"Dynamic Resolution", "Raymarching", true}; // Render the raymarch pass at a scaled resolution.
+  Parameter targetFps{"Target FPS", "Raymarching", 60.0, 24.0, 120.0}; // Frame rate the resolution is chosen for.
+  ParameterBool bakedSdf{"Baked SDF", "Raymarching", true}; // Fetch the cluster's distance from the baked volume.
+  ParameterBool singlePassStereo{"Single Pass Stereo", "Raymarching", true}; // Trace both eyes in one pass when rendering in stereo.
+  Parameter oscillationRate{"Oscillation Rate", "Clusters", 1.0, 0.0, 4.0}; // How fast the clusters oscillate per unit of spectral level.
+  Parameter oscillationDepth{"Oscillation Depth", "Clusters", 0.15, 0.0, 0.5}; // How far the clusters shrink at the peak of an oscillation.
   // Parameter orbitSpeed{"orbitSpeed", "Clusters", 0.1, 0.0, 10.0}; // The position of the cluster.
-  // Parameter fundamental{"Fundamental", "Oscillators", 220.0, 20.0, 20000.0}; // The fundamental frequency of the sine wave synthesizer.
+  Parameter fundamental{"Fundamental", "Oscillators", 220.0, 20.0, 20000.0}; // The fundamental frequency of the sine wave synthesizer.
+  Parameter glissando{"Glissando", "Oscillators", 1.0, 0.0, 8.0}; // Glissando rate between fundamentals in octaves per second, 0 jumps.
+  Parameter volume{"Volume", "Oscillators", 0.2, 0.0, 1.0}; // Output level of the oscillators.
+  Parameter fmAmount{"FM Amount", "Oscillators", 0.0, 0.0, 1.0}; // Amount of frequency modulation between approaching clusters.
+  Parameter fmDistance{"FM Distance", "Oscillators", 3.0, 0.0, 10.0}; // Clusters closer than this modulate each other.
+  Parameter reverbSend{"Reverb Send", "Reverb", 0.3, 0.0, 1.0}; // How much of a distant cluster is sent to the late reverb.
+  Parameter reverbTime{"Reverb Time", "Reverb", 2.5, 0.2, 10.0}; // Time for the late reverb to decay by 60 dB.
+  Parameter audioLoad{"Audio Load", "Audio", 0.0, 0.0, 2.0}; // Mean fraction of the block's duration the audio callback took, over the last frame.
+  Parameter audioPeak{"Audio Peak", "Audio", 0.0, 0.0, 2.0}; // Largest fraction over the last frame.
+  Parameter audioOverruns{"Overruns", "Audio", 0.0, 0.0, 1e6}; // Blocks which took longer than their duration.
+  ParameterBool stressMode{"Stress Test", "Audio", false}; // Add voices until the audio callback runs over budget.
+  Parameter stressVoices{"Stress Voices", "Audio", 0.0, 0.0, 16384.0}; // Voices added by the stress test.
+  ParameterBool latentControl{"Latent Control", "Grid", false}; // Drive the parameters from the grid controller through the decoder.
+  Parameter gridX{"Grid X", "Grid", 7.5, 0.0, 15.0}; // Column on the 8x16 grid controller.
+  Parameter gridY{"Grid Y", "Grid", 3.5, 0.0, 7.0}; // Row on the grid controller.
+  Parameter morphTime{"Morph Time", "Grid", 1.0, 0.0, 10.0}; // Seconds to move between grid states.
+  ParameterMenu morphEasing{"Morph Easing", "Grid"}; // How the move between grid states accelerates.
   // Parameter eyeSep{"Eye Separation", "Raymarching", 0.02, 0., 0.5};
   // Parameter focalLength{"Focal Length", "Raymarching", 0.02, 0., 0.5};
   // Parameter lightPos{"Light Position", "Raymarching", 0.02, 0., 0.5};
@@ -102,26 +157,95 @@ struct RayApp : public DistributedAppWithState<State> {
     auto guiDomain = GUIDomain::enableGUI(defaultWindowDomain()); // Enable the GUI.
     gui = &guiDomain->newGUI(); // Create the GUI
     // *gui << clusterPosX << clusterPosY << clusterPosZ; // Assign our parameters to the GUI.
+    *gui << dynamicRes << targetFps << bakedSdf << singlePassStereo; // Assign the raymarching parameters to the GUI.
+    *gui << fundamental << glissando << volume << fmAmount << fmDistance; // Assign the oscillator parameters to the GUI.
+    *gui << oscillationRate << oscillationDepth; // Assign the cluster parameters to the GUI.
+    *gui << reverbSend << reverbTime; // Assign the reverb parameters to the GUI.
+    *gui << latentControl << gridX << gridY << morphTime << morphEasing; // Assign the grid controller to the GUI.
+    *gui << audioLoad << audioPeak << audioOverruns << stressMode << stressVoices; // Assign the audio monitor to the GUI.
   }
 
   // parameterServer() << clusterPosX << clusterPosY << clusterPosZ; // Make parameters accessible via OSC.
+  parameterServer() << dynamicRes << targetFps << bakedSdf << singlePassStereo; // Make the raymarching parameters accessible via OSC.
+  parameterServer() << fundamental << glissando << volume << fmAmount << fmDistance; // Make the oscillator parameters accessible via OSC.
+  parameterServer() << oscillationRate << oscillationDepth; // Make the cluster parameters accessible via OSC.
+  parameterServer() << reverbSend << reverbTime; // Make the reverb parameters accessible via OSC.
+  parameterServer() << stressMode; // Start the stress test over OSC.
+  parameterServer() << latentControl << gridX << gridY << morphTime << morphEasing; // The grid controller sends its position over OSC.
   nav().pos(0.0 , 0.0, 0.1); // Set the camera position at the center of the 3D space.
+  clusterChannel = frameLog.channel("cluster1.pos", 10.0); // Log the cluster position at most ten times per second.
+  frameLog.echo = true; // Also print the log to the console, from the writer thread.
+  frameLog.start("harmonicSynth.flog"); // Start writing the binary log.
+  synth.setup(audioIO().framesPerBuffer(), audioIO().framesPerSecond(), audioIO().channelsOut()); // Allocate the audio graph before audio starts.
+  outputBlocks.resize(synth.speakers());
+  audioMonitor.setup(audioIO().framesPerBuffer(), audioIO().framesPerSecond()); // The callback's budget is one block.
+  stressTest.setup(audioIO().framesPerBuffer(), audioIO().framesPerSecond()); // Allocate the stress test's voices up front.
+  for (float& scale : clusterScale) scale = 1.0f; // Full size until there is a spectrum.
+  loadDecoder(); // Load the grid controller's decoder, if there is one.
   reloadShaders(); // Load the shader files.
+  bakeCluster(); // Bake the cluster's distance field.
   }  
 
-  // Reload the shader files when they are modified:
+  // Bake the static metaball arrangement into a 3D texture, reusing an earlier bake of the same shape:
+  void bakeCluster() {
+    auto scene = [&](const Vec3f& p) { return clusterShape.distance(p); }; // The cluster in its local space.
+    auto volume = sdfCache.get(clusterShape.key(), scene, sdfResolution, Vec3f(-1), Vec3f(1)); // Bake or fetch from the cache.
+    volume->upload(sdfTexture); // Send it to the GPU.
+  }
+
+  // Load the decoder's weights and decode every grid point up front, so moving on the grid only blends cached states:
+  void loadDecoder() {
+    latentTargets = {&fundamental, &glissando, &volume, &fmAmount, &fmDistance, &oscillationRate, &oscillationDepth, &reverbSend, &reverbTime};
+    morphEasing.setElements({"Linear", "Ease In", "Ease Out", "Smooth", "Ease In Cubic", "Ease Out Cubic"}); // In the order of Easing.
+    morphEasing.set(int(Easing::Smooth));
+    gridMorph.setup(int(latentTargets.size()));
+    for (size_t i = 0; i < latentTargets.size(); i++) gridMorph.define(int(i), *latentTargets[i], latentTargets[i] == &fundamental); // Frequencies morph in octaves.
+    std::string path = searchPaths.find("decoder.bin").filepath(); // Weights from the offline training, in the format in latentDecoder.hpp.
+    if (path.empty() || !latentDecoder.load(path)) {
+      printf("no grid decoder loaded, Latent Control has no effect\n");
+      return;
+    }
+    latentGrid.build(latentDecoder); // 16 columns by 8 rows.
+    latentState.resize(latentGrid.outputs());
+    printf("grid decoder: %d layers, %d latent dimensions, %d outputs\n", latentDecoder.layers(), latentDecoder.inputs(), latentDecoder.outputs());
+  }
+
+  // Morph the parameters to the grid position's state, when it moves. Each output of the decoder, from 0 to 1,
+  // spans its parameter's range:
+  void applyGrid(double dt) {
+    gridMorph.advance(float(dt)); // Every parameter in one pass.
+    for (size_t i = 0; i < latentTargets.size(); i++) {
+      if (gridMorph.changed(int(i))) *latentTargets[i] = gridMorph.value(int(i)); // Only those moving, so the GUI can still set the rest.
+    }
+    if (!latentControl || latentGrid.empty()) return;
+    float x = gridX, y = gridY;
+    if (x == lastGridX && y == lastGridY) return;
+    lastGridX = x;
+    lastGridY = y;
+    latentGrid.lookup(x, y, latentState.data()); // Blend the four nearest cached states.
+    int count = std::min(int(latentState.size()), int(latentTargets.size()));
+    for (int i = 0; i < count; i++) {
+      Parameter& target = *latentTargets[i];
+      float t = std::min(std::max(latentState[i], 0.0f), 1.0f);
+      gridMorph.jump(i, target); // From wherever the GUI left it.
+      gridMorph.morph(i, target.min() + t * (target.max() - target.min()), morphTime, Easing(morphEasing.get()));
+    }
+  }
+
+  // Load the shader files, and reload them in the background when they are modified:
   void reloadShaders() {
-    loadShader(clusters, "clusters.vert", "clusters.frag"); // Call the loadShader function to reload the shader program.
+    shaderWatcher.searchPaths(&searchPaths); // Find shader files and includes in our search paths.
+    shaderWatcher.add(clusters, "clusters.vert", "clusters.frag"); // The raymarch program.
+    shaderWatcher.add(upsample, "clusters.vert", "upsample.frag"); // The upsampling pass shares the ray generation of the raymarch pass.
+    shaderWatcher.add(clustersStereo, "clustersStereo.vert", "clustersStereo.frag"); // The single pass stereo program.
+    shaderWatcher.start(); // Start watching for changes.
   }
 
   // Animate loop, here we'll watch for changes in the shader files and the camera pose:
   void onAnimate(double dt) override {
 
-    // Watch for changes in the shader files, and update accordingly:
-    if (watchCheck()) { // If the shader files have been modified...
-      printf("shader files changed, reloading..\n"); // Print a message stating that the files have been changed.
-      reloadShaders(); // Reload the shaders.
-    }
+    // Swap in shaders which were edited and compile, without waiting on the watcher thread:
+    shaderWatcher.update();
     // **Ask Karl what's going on here:**
     if(isPrimary()){ // If the app is the primary instance...
       state().pose.set(nav()); // Set the state's pose to the camera's pose.
@@ -129,78 +253,391 @@ struct RayApp : public DistributedAppWithState<State> {
       nav().set(state().pose); // Set the camera's pose to the state's pose.
     }
 
+    // Choose the internal resolution of the raymarch pass from its GPU time, not the frame time,
+    // which vsync holds at the refresh period however fast the pass gets:
+    resolution.targetFps(targetFps); // Set the budget of the pass.
+    if (dynamicRes) { // If dynamic resolution is enabled...
+      upsampler.measure(resolution); // Feed the time the last measured pass took.
+    } else {
+      resolution.reset(); // Otherwise stay at native resolution.
+    }
+
+    applyGrid(dt); // Move to the grid controller's state.
+    simulate(dt); // Advance the piece by a frame.
+    monitorAudio(); // Show how close the audio callback is to its deadline.
+  }
+
+  // Show the audio callback's load, and run the stress test when it's switched on:
+  void monitorAudio() {
+    float mean, peak;
+    audioMonitor.recent(mean, peak); // Every block since the last frame.
+    audioLoad = mean;
+    audioPeak = peak;
+    audioOverruns = float(audioMonitor.stats().overruns);
+    if (stressMode && !stressStarted) { // Switched on.
+      stressTest.start();
+      stressStarted = true;
+    } else if (!stressMode && stressStarted) { // Switched off.
+      stressTest.stop();
+      stressStarted = false;
+    }
+    stressVoices = float(stressTest.running() ? stressTest.voices() : 0);
+    if (stressStarted && stressTest.finished()) { // The budget was breached, or the voices ran out.
+      printf("stress test: %d voices sustained on top of the synth%s\n", stressTest.sustained(), stressTest.capped() ? ", the most the test has, the budget was never breached" : "");
+      stressMode = false;
+      stressStarted = false;
+    }
+  }
+
+  // Advance the piece by a frame and hand the synth parameters to the audio thread. Everything here
+  // follows the frame count and the analysis, so offline renders replay it exactly:
+  void simulate(double dt) {
     timer += 0.01;
     float radius = 5.0;
     float orbitX = radius * sin(timer);
     float orbitY = radius * cos(timer);
     cluster1.pos(orbitX, 0.0, orbitY);
-    std::cout << cluster1.pos() << std::endl;
+    oscillateClusters(dt); // Oscillate the clusters with the spectrum of their synthesizers.
+    frameLog.log(clusterChannel, cluster1.pos().x, cluster1.pos().y, cluster1.pos().z, 0.0f, 3); // Log the position without touching stdout.
+    frameLog.frame(); // Advance the frame counter of the log.
+
+    // Hand this frame's synth parameters to the audio thread. Parameters are only read here,
+    // so however often the GUI or OSC change them, the audio thread sees one snapshot per frame:
+    SynthSnapshot& snapshot = synth.params.back(); // The snapshot being filled.
+    for (int c = 0; c < numClusters; c++) {
+      ClusterParams& params = snapshot.clusters[c];
+      for (int a = 0; a < 3; a++) params.position[a] = cluster1.pos()[a];
+      Vec3d relative = nav().quat().conj().rotate(Vec3d(cluster1.pos() - nav().pos())); // Into the listener's frame.
+      for (int a = 0; a < 3; a++) params.relative[a] = relative[a];
+      params.fundamental = fundamental;
+      params.glissando = glissando;
+      params.fmAmount = fmAmount;
+    }
+    snapshot.volume = volume;
+    snapshot.fmDistance = fmDistance;
+    snapshot.reverbSend = reverbSend;
+    snapshot.reverbTime = reverbTime;
+    synth.params.publish(); // Publish it without waiting on the audio thread.
   }
 
-  void onDraw(Graphics &g) override {
-    g.clear(0); // Clear the graphics buffer.
-    clusters.use(); // Use the raymarched shader program.
-    clusters.uniform("clusterPos", cluster1.pos()) // Pass the position of the cluster to the shader.
+  // Oscillate each cluster at a rate set by its synthesizer's spectrum. Every band contributes to the rate,
+  // higher bands more, so brighter sounds oscillate faster. Louder sounds oscillate deeper:
+  void oscillateClusters(double dt) {
+    synth.spectrum.update(); // Take the latest levels from the analysis, if there are new ones.
+    const auto& levels = synth.spectrum.levels();
+    for (int c = 0; c < numClusters; c++) {
+      float rate = 0.0f, level = 0.0f;
+      for (int b = 0; b < numBands; b++) {
+        rate += levels.level[c][b] * (b + 1); // Each band contributes to the rate.
+        level += levels.level[c][b];
+      }
+      oscillationPhase[c] = std::fmod(oscillationPhase[c] + float(dt) * 2.0f * float(M_PI) * rate * oscillationRate, 2.0f * float(M_PI));
+      float depth = oscillationDepth * std::min(level, 1.0f);
+      clusterScale[c] = 1.0f - depth * (0.5f + 0.5f * std::sin(oscillationPhase[c])); // Only shrink, so the cluster stays in its bounding box.
+    }
+  }
+
+  // Audio callback, renders the audio graph a block at a time:
+  void onSound(AudioIOData &io) override {
+    audioMonitor.begin(); // Time the whole block.
+    for (int m = 0; m < synth.speakers(); m++) outputBlocks[m] = io.outBuffer(m); // One buffer per speaker.
+    synth.process(outputBlocks.data(), io.framesPerBuffer());
+    stressTest.process(io.framesPerBuffer(), audioMonitor.last()); // Extra voices, when stress testing.
+    audioMonitor.end();
+  }
+
+  // When quitting, report the audio callback's load and flush the log:
+  void onExit() override {
+    synth.stop(); // Stop the analysis.
+    audioMonitor.dump(); // The callback's load histogram and xruns.
+    frameLog.stop();
+  }
+
+  // Pass the camera and scene uniforms shared by the raymarch and upsampling passes:
+  void rayUniforms(ShaderProgram& program, Graphics &g) {
+    program.uniform("clusterPos", cluster1.pos()) // Pass the position of the cluster to the shader.
     .uniform("cam_pos", nav().pos()) // Position of the camera.
     .uniform("foc_len", g.lens().focalLength()) // Focal length of the lens.
     .uniform("eye_sep", g.lens().eyeSep() * g.eye() / 2.0f) // Eye separation.
+    .uniform("cluster_scale", clusterScale[0]) // Size of the cluster.
+    .uniform("jitter", Vec2f(0, 0)) // No sub-pixel jitter unless dynamic resolution sets one.
+    .uniform("sdf_volume", 2) // The baked volume is bound to texture unit 2.
+    .uniform("use_volume", bakedSdf ? 1 : 0) // Whether to fetch distances from it.
+    .uniform("volume_min", Vec3f(-1)) // The region covered by the baked volume.
+    .uniform("volume_max", Vec3f(1))
     .uniform("al_ProjMatrixInv", Matrix4f::inverse(g.projMatrix())) // Pass the inverse projection matrix to the shader.
     .uniform("al_ViewMatrixInv", Matrix4f::inverse(g.viewMatrix())) // Pass the inverse view matrix to the shader.
     .uniform("al_ModelMatrixInv", Matrix4f::inverse(g.modelMatrix())); // Pass the inverse model matrix to the shader.
+  }
+
+  void onDraw(Graphics &g) override {
+    g.clear(0); // Clear the graphics buffer.
+    sdfTexture.bind(2); // Bind the baked distance volume.
+    if (singlePassStereo && g.eye() != 0) { // If rendering in stereo...
+      upsampler.skip(); // The history goes stale meanwhile.
+      drawStereo(g); // Trace both eyes in one pass.
+      return;
+    }
+    if (!dynamicRes) { // If dynamic resolution is disabled...
+      upsampler.skip(); // The history goes stale meanwhile.
+      clusters.live().use(); // Use the raymarched shader program.
+      rayUniforms(clusters.live(), g); // Pass the uniforms.
+      quad.draw(); // Draw the quad mesh displaying the raymarched scene.
+      return;
+    }
+
+    // Raymarch at the scaled resolution:
+    upsampler.resize(fbWidth(), fbHeight(), resolution); // Match the render targets to the window and scale.
+    upsampler.views(g.eye()); // Each stereo eye resolves on its own, there's one history.
+    upsampler.begin(g); // Render offscreen.
+    clusters.live().use(); // Use the raymarched shader program.
+    rayUniforms(clusters.live(), g); // Pass the uniforms.
+    clusters.live().uniform("jitter", upsampler.jitter()); // Offset the rays by this frame's sub-pixel jitter.
     quad.draw(); // Draw the quad mesh displaying the raymarched scene.
+    upsampler.end(g); // Back to the screen.
+
+    // Reconstruct the full resolution image from the scaled image and the history:
+    upsample.live().use(); // Use the upsampling shader program.
+    rayUniforms(upsample.live(), g); // The upsampling pass needs the same rays.
+    upsampler.resolve(g, upsample.live(), quad, g.projMatrix() * g.viewMatrix(), nav().pos()); // Reproject, blend and draw.
+  }
+
+  // Single pass stereo. The left eye is drawn first (eye -1), and traces both eyes into the two
+  // attachments of the stereo framebuffer. The right eye (eye 1) only draws the image already traced.
+  // Dynamic resolution does not apply here, the stereo targets are at native resolution.
+  void drawStereo(Graphics &g) {
+    if (g.eye() < 0) { // If this is the left eye...
+      resizeStereo(fbWidth(), fbHeight()); // Match the stereo targets to the window.
+      g.pushFramebuffer(stereoFbo); // Render offscreen.
+      g.pushViewport(0, 0, stereoWidth, stereoHeight);
+      g.clear(0);
+      clustersStereo.live().use(); // Use the single pass stereo program.
+      rayUniforms(clustersStereo.live(), g); // Pass the uniforms.
+      clustersStereo.live().uniform("eye_half_sep", g.lens().eyeSep() / 2.0f); // Both eyes are offset in the vertex shader.
+      quad.draw(); // Trace both eyes.
+      g.popViewport();
+      g.popFramebuffer();
+    }
+    g.pushCamera(Viewpoint::IDENTITY); // Draw in normalized device coordinates.
+    g.blending(false); // The alpha channel holds distances, not coverage.
+    g.quad(stereoTex[g.eye() < 0 ? 0 : 1], -1, -1, 2, 2); // Draw this eye's image.
+    g.popCamera();
+  }
+
+  // Allocate the stereo targets when the window size changes:
+  void resizeStereo(int w, int h) {
+    if (w == stereoWidth && h == stereoHeight) return; // Nothing to do.
+    stereoWidth = w;
+    stereoHeight = h;
+    stereoFbo.bind();
+    for (int i = 0; i < 2; i++) {
+      stereoTex[i].create2D(w, h, GL_RGBA32F, GL_RGBA, GL_FLOAT); // Color, with the hit distance in alpha.
+      stereoFbo.attachTexture2D(stereoTex[i], GL_COLOR_ATTACHMENT0 + i); // One attachment per eye.
+    }
+    GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, buffers); // Write frag_out0 and frag_out1 to the two attachments.
+    stereoFbo.unbind();
+  }
+
+  // Check the single pass stereo against two separate passes with the CPU reference tracer,
+  // for the current cluster position seen from the current camera pose:
+  void verifyStereoPass() {
+    Vec3f clusterPos = cluster1.pos();
+    float scale = clusterScale[0];
+    auto scene = [&](const Vec3f& p) { return clusterShape.distance((p - clusterPos) / scale) * scale; }; // The cluster in world space, at its current size.
+    StereoCheck check = verifyStereo(scene, clusterPos, Vec3f(nav().pos()), Vec3f(nav().ur()), Vec3f(nav().uu()), Vec3f(nav().uf()), lens().fovy(), float(fbWidth()) / fbHeight(), lens().eyeSep(), lens().focalLength(), 120, 80);
+    printf("stereo check: %d / %d pixels differ, max distance error %f, single pass costs %.2fx of two passes\n",
+      check.mismatches, check.pixels, check.maxDistError, double(check.stepsSinglePass) / double(check.stepsTwoPass));
   }
 
   // Respond to keystrokes:
-  bool onKeyDown(const Keyboard &k) override {}
-
-  // Choose file to watch for changes.
-  void watchFile(std::string path) {
-    File file(searchPaths.find(path).filepath()); // Find the file in the search paths.
-    watchedFiles[path] = WatchedFile{ file, file.modified() };
-  }
-
-  // Watch for changes in files:
-  bool watchCheck() {
-    bool changed = false; // A flag to indicate if the files have changed, false by default.
-    if (floor(al_system_time()) > watchCheckTime) { // If the time has passed since the last check...
-      watchCheckTime = floor(al_system_time()); // Set the time of the last check to the current time.
-      for (std::map <std::string, WatchedFile>::iterator i = watchedFiles.begin(); i != watchedFiles.end(); i++) { // Iterate through the watched files.
-        WatchedFile& watchedFile = (*i).second; // Retrieve the files.
-        if (watchedFile.modified != watchedFile.file.modified()) { // If the file has been modified...
-          watchedFile.modified = watchedFile.file.modified(); // Set the modified time to the current time.
-          changed = true; // Set the changed flag to true.
-        }
+  bool onKeyDown(const Keyboard &k) override {
+    if (k.key() == 'v') { // Press v to...
+      verifyStereoPass(); // Check the single pass stereo on the CPU.
+    }
+    return true;
+  }
+
+  // Render the piece without an audio device or a window, as fast as possible. The timeline is a fixed
+  // frame rate: each frame is simulated, then the audio up to the start of the next frame is rendered
+  // and analyzed in line, so two renders with the same arguments are identical. The audio is written to
+  // a multichannel WAV file and the state of every cluster on every frame to path.frames.csv.
+  // Files are written on another thread while the next chunk renders.
+  bool renderOffline(const std::string& path, double seconds, int outputs, double fps = 60.0, int blockSize = 512, int sampleRate = 44100) {
+    synth.setup(blockSize, sampleRate, outputs, false); // Analyze in line, for a deterministic render.
+    for (float& scale : clusterScale) scale = 1.0f;
+    WavWriter wav;
+    FILE* frames = fopen((path + ".frames.csv").c_str(), "w");
+    if (!wav.open(path, synth.speakers(), sampleRate) || !frames) {
+      printf("could not open %s\n", path.c_str());
+      if (frames) fclose(frames);
+      return false;
+    }
+    fprintf(frames, "frame,time");
+    for (int c = 0; c < numClusters; c++) fprintf(frames, ",x%d,y%d,z%d,scale%d", c, c, c, c);
+    fprintf(frames, "\n");
+
+    // Two chunks of about a second, one rendering while the other is written:
+    int chunkFrames = sampleRate / blockSize * blockSize;
+    std::vector<float> chunks[2];
+    std::vector<float*> chunkOut[2];
+    for (int k = 0; k < 2; k++) {
+      chunks[k].assign(size_t(synth.speakers()) * chunkFrames, 0.0f);
+      for (int m = 0; m < synth.speakers(); m++) chunkOut[k].push_back(&chunks[k][size_t(m) * chunkFrames]);
+    }
+    std::vector<float*> blockOut(synth.speakers());
+    std::future<void> writing;
+    int chunk = 0, filled = 0;
+    auto flush = [&]() { // Hand the filled chunk to the writer and switch to the other one.
+      if (writing.valid()) writing.wait();
+      int k = chunk, count = filled;
+      writing = std::async(std::launch::async, [&wav, &chunkOut, k, count]() { wav.write(chunkOut[k].data(), count); });
+      chunk = 1 - chunk;
+      filled = 0;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    long total = long(seconds * sampleRate), rendered = 0;
+    int frameCount = int(seconds * fps);
+    for (int f = 0; f < frameCount; f++) {
+      simulate(1.0 / fps); // The frame.
+      fprintf(frames, "%d,%f", f, f / fps);
+      for (int c = 0; c < numClusters; c++) fprintf(frames, ",%f,%f,%f,%f", cluster1.pos().x, cluster1.pos().y, cluster1.pos().z, clusterScale[c]);
+      fprintf(frames, "\n");
+      long frameEnd = std::min(total, long((f + 1) * sampleRate / fps)); // The audio up to the next frame.
+      while (rendered < frameEnd) {
+        int count = int(std::min(long(std::min(blockSize, chunkFrames - filled)), frameEnd - rendered));
+        for (int m = 0; m < synth.speakers(); m++) blockOut[m] = chunkOut[chunk][m] + filled;
+        synth.process(blockOut.data(), count);
+        synth.analyze(); // The next frame sees this block's spectrum.
+        rendered += count;
+        filled += count;
+        if (filled == chunkFrames) flush();
       }
     }
-    return changed; // Return the changed flag boolean.
-  }
-
-  // Change file if modified:   
-  std::string loadGlsl(std::string filename) {
-    watchFile(filename); // Watch the input file for changes.
-		std::string code = File::read(searchPaths.find(filename).filepath()); // Read the file.
-		size_t from = code.find("#include \""); // Find the include directive.
-		if (from != std::string::npos) { // If the include directive is found...
-			size_t capture = from + strlen("#include \""); // Begin the catpuring the code.
-			size_t to = code.find("\"", capture); // End code capture.
-			std::string include_filename = code.substr(capture, to-capture); // Get the filename.
-			std::string replacement = File::read(searchPaths.find(include_filename).filepath());  // Read the file.
-			code = code.replace(from, to-from+2, replacement); // Replace the include directive with the code inside of the file.
-			//printf("code: %s\n", code.data());
-		}
-		return code; // Return the code.
-	}
-
-  // Load a shader program from file:
-  void loadShader(ShaderProgram& program, std::string vp_filename, std::string fp_filename) {
-	  std::string vp = loadGlsl(vp_filename); // Load the vertex shader.
-	  std::string fp = loadGlsl(fp_filename); // Load the fragment shader.
-	  program.compile(vp, fp); // Compile the shader program.
+    if (filled > 0) flush();
+    if (writing.valid()) writing.wait();
+    wav.close();
+    fclose(frames);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("offline render: %.1f seconds, %d channels, %d frames in %.2f seconds (%.1fx real time) to %s\n",
+      seconds, synth.speakers(), frameCount, elapsed, seconds / elapsed, path.c_str());
+    return true;
   }
 };
 
+// Print how many oscillators one core can render in real time:
+void runBenchmarks() {
+  for (int voices : {64, 256, 1024}) {
+    double speed = benchmarkOscillatorBank(voices); // Times faster than real time.
+    printf("oscillator bank: %d voices at %.1fx real time, about %.0f voices per core at 44.1 kHz\n", voices, speed, voices * speed);
+  }
+  for (int voices : {16, 64, 256}) {
+    double speed = benchmarkReverb(voices); // Times faster than real time.
+    printf("reverb network: %d voices at %.1fx real time, about %.0f voices per core at 44.1 kHz\n", voices, speed, voices * speed);
+  }
+  double speed = benchmarkSpectrumAnalyzer<64>(); // Dozens of voices, 1024 point FFTs every 256 samples.
+  printf("spectrum analyzer: 64 channels at %.1fx real time, %.0f%% of each audio block\n", speed, 100.0 / speed);
+  for (int hidden : {64, 256, 1024}) {
+    double decode, lookup;
+    benchmarkLatentDecoder(hidden, 3, 9, decode, lookup); // Two hidden layers, nine parameters out.
+    printf("latent decoder: %d wide at %.2f us per decode, %.3f us per cached grid lookup\n", hidden, decode, lookup);
+  }
+  for (int count : {100, 1000, 10000}) {
+    printf("morph scheduler: %d parameters at %.2f us per frame\n", count, benchmarkMorphScheduler(count));
+  }
+  float fromPass, fromFrame;
+  bool recovered = checkResolutionRecovery(fromPass, fromFrame);
+  printf("resolution controller: after a slow spike, scale %.3f fed the pass time (%s), %.3f fed the vsync capped frame time\n",
+    fromPass, recovered ? "recovered" : "DID NOT RECOVER", fromFrame);
+  StereoCheck front, turned;
+  bool matched = checkStereoOcclusion(front, turned);
+  printf("single pass stereo: %d and %d pixels where only the right eye sees the post, %d and %d differ from two passes (%s), single pass costs %.2fx of two passes\n",
+    front.rightOnly, turned.rightOnly, front.mismatches, turned.mismatches, matched ? "matched" : "MISMATCHED", double(front.stepsSinglePass) / double(front.stepsTwoPass));
+}
+
+// Add voices on top of the synth, rendering back to back without a device, until a block takes
+// more than 90% of its duration, and print the most voices sustained:
+void runStressTest(int blockSize = 512, int sampleRate = 44100, int outputs = 2) {
+  SynthEngine synth;
+  synth.setup(blockSize, sampleRate, outputs, false);
+  SynthSnapshot& snapshot = synth.params.back(); // A cluster in front of the listener.
+  for (ClusterParams& cluster : snapshot.clusters) {
+    cluster = ClusterParams{{0.0f, 0.0f, -5.0f}, {0.0f, 0.0f, -5.0f}, 220.0f, 1.0f, 0.5f};
+  }
+  snapshot.volume = 0.2f;
+  snapshot.fmDistance = 3.0f;
+  snapshot.reverbSend = 0.3f;
+  snapshot.reverbTime = 2.5f;
+  synth.params.publish();
+  std::vector<float> speakers(size_t(synth.speakers()) * blockSize);
+  std::vector<float*> out(synth.speakers());
+  for (int m = 0; m < synth.speakers(); m++) out[m] = &speakers[size_t(m) * blockSize];
+  AudioMonitor monitor;
+  monitor.setup(blockSize, sampleRate);
+  StressTest stress;
+  stress.setup(blockSize, sampleRate);
+  stress.start();
+  while (!stress.finished()) {
+    monitor.begin();
+    synth.process(out.data(), blockSize);
+    stress.process(blockSize, monitor.last());
+    monitor.end();
+    synth.analyze(); // The worker's share, outside the callback.
+  }
+  monitor.dump();
+  printf("stress test: %d voices sustained on top of the synth, %d outputs%s\n", stress.sustained(), synth.speakers(),
+    stress.capped() ? ", the most the test has, the budget was never breached" : "");
+}
+
+// Render a tone circling the listener through the AlloSphere's speakers, to check the panning offline:
+void renderSpatialTest(const std::string& path, double seconds = 8.0, int blockSize = 512, int sampleRate = 44100) {
+  OscillatorBank bank;
+  bank.setup(1, blockSize, sampleRate);
+  bank.frequency(0, 440.0f);
+  bank.amplitude(0, 0.5f);
+  Spatializer panner;
+  panner.setup(SpeakerLayout::allosphere(), 1);
+  std::vector<float> speakers(size_t(panner.speakers()) * blockSize);
+  std::vector<float*> out(panner.speakers());
+  for (int m = 0; m < panner.speakers(); m++) out[m] = &speakers[size_t(m) * blockSize];
+  WavWriter wav;
+  if (!wav.open(path, panner.speakers(), sampleRate)) {
+    printf("could not open %s\n", path.c_str());
+    return;
+  }
+  int blocks = int(seconds * sampleRate / blockSize);
+  for (int b = 0; b < blocks; b++) {
+    double t = double(b) * blockSize / sampleRate;
+    double angle = 2.0 * M_PI * t / seconds; // One turn, starting in front.
+    panner.position(0, float(2.0 * std::sin(angle)), float(std::sin(3.0 * angle)), float(-2.0 * std::cos(angle))); // Rising and falling as it circles.
+    bank.render(blockSize);
+    const float* source = bank.output(0);
+    panner.process(&source, 1, out.data(), blockSize);
+    wav.write(out.data(), blockSize);
+  }
+  printf("spatial test: %d speakers, %.1f seconds written to %s\n", panner.speakers(), seconds, path.c_str());
+}
+
 // Main Function:
-int main() {
+int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") { // Run with --benchmark to measure the audio engine.
+    runBenchmarks();
+    return 0;
+  }
+  if (argc > 1 && std::string(argv[1]) == "--stress") { // Run with --stress [channels] to find the polyphony one core sustains.
+    runStressTest(512, 44100, argc > 2 ? atoi(argv[2]) : 2);
+    return 0;
+  }
+  if (argc > 1 && std::string(argv[1]) == "--spatial-test") { // Run with --spatial-test [file] to render the panning to a WAV file.
+    renderSpatialTest(argc > 2 ? argv[2] : "spatialTest.wav");
+    return 0;
+  }
+  if (argc > 1 && std::string(argv[1]) == "--offline") { // Run with --offline [seconds] [file] [channels] to render without a device.
+    RayApp app;
+    bool ok = app.renderOffline(argc > 3 ? argv[3] : "harmonicSynth.wav", argc > 2 ? atof(argv[2]) : 60.0, argc > 4 ? atoi(argv[4]) : 2);
+    return ok ? 0 : 1;
+  }
   RayApp app;
   app.configureAudio(44100, 512, 2, 0);
   app.dimensions(1200, 800);
@@ -0,0 +1,234 @@
+// Latent Decoder:
+//
+// Maps a position on the 8x16 grid controller to a whole parameter state, through the decoder half
+// of a variational autoencoder trained offline.
+//
+// - MlpDecoder runs a small multilayer perceptron on the CPU. Its weights are loaded from a flat
+//   binary file, and every buffer is allocated when it loads, so decode() never allocates.
+// - Each layer is one fused pass: the matrix-vector product, the bias and the activation. Rows are
+//   padded to a multiple of 8 floats and summed into 8 independent accumulators, so the compiler
+//   can keep the inner loop in SIMD registers without fast math.
+// - GridCache decodes the state at every grid point once, when the decoder loads. Moving on the
+//   grid then only blends the four nearest cached states bilinearly, which costs the same
+//   whatever the size of the model.
+//
+// File format, little endian:
+//   char magic[4] = "MLP1", uint32 layers,
+//   then per layer: uint32 inputs, uint32 outputs, uint32 activation,
+//   float weights[outputs][inputs], float biases[outputs].
+// Each layer's inputs must match the previous layer's outputs.
+
+#pragma once
+
+#include <algorithm> // For std::min, std::max, std::fill.
+#include <chrono> // For the benchmark.
+#include <cmath> // For std::tanh, std::exp.
+#include <cstdint> // For the file header.
+#include <cstdio> // For reading the weights.
+#include <cstring> // For std::memcmp.
+#include <random> // For the benchmark's weights.
+#include <string> // For the file path.
+#include <vector> // For the weights and activations.
+
+enum class Activation : uint32_t { Linear = 0, Relu = 1, Tanh = 2, Sigmoid = 3 };
+
+class MlpDecoder {
+public:
+  // Add a layer, its weights zeroed. Inputs must match the last layer's outputs:
+  bool layer(int inputs, int outputs, Activation activation) {
+    if (inputs <= 0 || outputs <= 0) return false;
+    if (!mLayers.empty() && mLayers.back().outputs != inputs) return false;
+    Layer l;
+    l.inputs = inputs;
+    l.outputs = outputs;
+    l.stride = (inputs + 7) & ~7; // Padded to whole groups of 8.
+    l.activation = activation;
+    l.weights.assign(size_t(outputs) * l.stride, 0.0f);
+    l.biases.assign(outputs, 0.0f);
+    size_t width = size_t(std::max(l.stride, (outputs + 7) & ~7));
+    mLayers.push_back(std::move(l));
+    if (mA.size() < width) { // The activations are read in groups of 8, so the padding stays zero.
+      mA.assign(width, 0.0f);
+      mB.assign(width, 0.0f);
+    }
+    return true;
+  }
+
+  // Remove every layer:
+  void clear() {
+    mLayers.clear();
+    mA.clear();
+    mB.clear();
+  }
+
+  // Load the layers from a weights file, see the format above:
+  bool load(const std::string& path) {
+    clear();
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char magic[4];
+    uint32_t count = 0;
+    bool ok = fread(magic, 1, 4, file) == 4 && std::memcmp(magic, "MLP1", 4) == 0 && fread(&count, 4, 1, file) == 1 && count > 0;
+    for (uint32_t i = 0; ok && i < count; i++) {
+      uint32_t header[3];
+      ok = fread(header, 4, 3, file) == 3 && header[2] <= uint32_t(Activation::Sigmoid) && header[0] <= 65536 && header[1] <= 65536;
+      ok = ok && layer(int(header[0]), int(header[1]), Activation(header[2]));
+      if (!ok) break;
+      Layer& l = mLayers.back();
+      for (int o = 0; ok && o < l.outputs; o++) ok = fread(&l.weights[size_t(o) * l.stride], 4, l.inputs, file) == size_t(l.inputs); // One row at a time, into the padded rows.
+      ok = ok && fread(l.biases.data(), 4, l.outputs, file) == size_t(l.outputs);
+    }
+    fclose(file);
+    if (!ok) clear();
+    return ok;
+  }
+
+  int inputs() const { return mLayers.empty() ? 0 : mLayers.front().inputs; }
+  int outputs() const { return mLayers.empty() ? 0 : mLayers.back().outputs; }
+  int layers() const { return int(mLayers.size()); }
+
+  // Weights of a layer, outputs rows of stride(layer) floats, and its biases:
+  float* weights(int layer) { return mLayers[layer].weights.data(); }
+  float* biases(int layer) { return mLayers[layer].biases.data(); }
+  int stride(int layer) const { return mLayers[layer].stride; }
+
+  // Decode a latent vector of inputs() floats into outputs() floats. Never allocates:
+  void decode(const float* latent, float* out) {
+    if (mLayers.empty()) return;
+    float* in = mA.data();
+    float* next = mB.data();
+    std::copy(latent, latent + inputs(), in);
+    std::fill(in + inputs(), in + mLayers.front().stride, 0.0f);
+    for (size_t i = 0; i < mLayers.size(); i++) {
+      const Layer& l = mLayers[i];
+      bool last = i + 1 == mLayers.size();
+      forward(l, in, last ? out : next);
+      if (last) break;
+      int padded = mLayers[i + 1].stride;
+      std::fill(next + l.outputs, next + padded, 0.0f); // The next layer reads whole groups of 8.
+      std::swap(in, next);
+    }
+  }
+
+private:
+  struct Layer {
+    int inputs = 0, outputs = 0, stride = 0;
+    Activation activation = Activation::Linear;
+    std::vector<float> weights; // outputs rows of stride floats, zero padded.
+    std::vector<float> biases;
+  };
+  std::vector<Layer> mLayers;
+  std::vector<float> mA, mB; // Ping-pong activations between layers.
+
+  // One layer: out = activation(weights * in + biases), in one pass over the weights:
+  static void forward(const Layer& l, const float* in, float* out) {
+    for (int o = 0; o < l.outputs; o++) {
+      const float* row = &l.weights[size_t(o) * l.stride];
+      float sum[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}; // Independent sums, one SIMD register.
+      for (int i = 0; i < l.stride; i += 8) {
+        for (int k = 0; k < 8; k++) sum[k] += row[i + k] * in[i + k];
+      }
+      float x = l.biases[o] + ((sum[0] + sum[4]) + (sum[1] + sum[5])) + ((sum[2] + sum[6]) + (sum[3] + sum[7]));
+      switch (l.activation) {
+        case Activation::Relu: x = std::max(x, 0.0f); break;
+        case Activation::Tanh: x = std::tanh(x); break;
+        case Activation::Sigmoid: x = 1.0f / (1.0f + std::exp(-x)); break;
+        default: break;
+      }
+      out[o] = x;
+    }
+  }
+};
+
+// Decoded states at every point of the grid controller, blended bilinearly in between:
+class GridCache {
+public:
+  // Decode the state at every grid point. The columns span latent x from latentMin to latentMax and
+  // the rows latent y, the other latent dimensions are zero. With subdivisions, points are also
+  // cached between the cells, for a closer match to the decoder:
+  void build(MlpDecoder& decoder, int columns = 16, int rows = 8, float latentMin = -2.0f, float latentMax = 2.0f, int subdivisions = 1) {
+    mSub = std::max(subdivisions, 1);
+    mColumns = columns;
+    mRows = rows;
+    mPointsX = (columns - 1) * mSub + 1;
+    mPointsY = (rows - 1) * mSub + 1;
+    mOutputs = decoder.outputs();
+    mStates.assign(size_t(mPointsX) * mPointsY * mOutputs, 0.0f);
+    std::vector<float> latent(std::max(decoder.inputs(), 2), 0.0f);
+    for (int y = 0; y < mPointsY; y++) {
+      for (int x = 0; x < mPointsX; x++) {
+        latent[0] = latentMin + (latentMax - latentMin) * x / std::max(mPointsX - 1, 1);
+        latent[1] = latentMin + (latentMax - latentMin) * y / std::max(mPointsY - 1, 1);
+        decoder.decode(latent.data(), state(x, y));
+      }
+    }
+  }
+
+  bool empty() const { return mStates.empty(); }
+  int outputs() const { return mOutputs; }
+  int columns() const { return mColumns; }
+  int rows() const { return mRows; }
+
+  // The state at a position on the grid, column in [0, columns - 1] and row in [0, rows - 1]. Never allocates:
+  void lookup(float column, float row, float* out) const {
+    if (mStates.empty()) return;
+    float fx = std::min(std::max(column * mSub, 0.0f), float(mPointsX - 1));
+    float fy = std::min(std::max(row * mSub, 0.0f), float(mPointsY - 1));
+    int x0 = std::min(int(fx), std::max(mPointsX - 2, 0)), y0 = std::min(int(fy), std::max(mPointsY - 2, 0));
+    int x1 = std::min(x0 + 1, mPointsX - 1), y1 = std::min(y0 + 1, mPointsY - 1);
+    float tx = fx - x0, ty = fy - y0;
+    const float* a = state(x0, y0);
+    const float* b = state(x1, y0);
+    const float* c = state(x0, y1);
+    const float* d = state(x1, y1);
+    for (int i = 0; i < mOutputs; i++) {
+      float top = a[i] + (b[i] - a[i]) * tx;
+      float bottom = c[i] + (d[i] - c[i]) * tx;
+      out[i] = top + (bottom - top) * ty;
+    }
+  }
+
+private:
+  int mColumns = 0, mRows = 0, mSub = 1, mPointsX = 0, mPointsY = 0, mOutputs = 0;
+  std::vector<float> mStates; // Row major grid points of mOutputs floats.
+
+  float* state(int x, int y) { return &mStates[(size_t(y) * mPointsX + x) * mOutputs]; }
+  const float* state(int x, int y) const { return &mStates[(size_t(y) * mPointsX + x) * mOutputs]; }
+};
+
+// Time a decoder of random weights against cache lookups, returns microseconds per decode and per lookup:
+inline void benchmarkLatentDecoder(int hidden, int layers, int outputs, double& decodeMicros, double& lookupMicros, int iterations = 2000) {
+  MlpDecoder decoder;
+  std::mt19937 random(1);
+  std::normal_distribution<float> normal(0.0f, 1.0f);
+  int inputs = 2;
+  for (int l = 0; l < layers; l++) {
+    bool last = l + 1 == layers;
+    int width = last ? outputs : hidden;
+    decoder.layer(inputs, width, last ? Activation::Sigmoid : Activation::Relu);
+    float scale = 1.0f / std::sqrt(float(inputs));
+    for (int o = 0; o < width; o++) {
+      for (int i = 0; i < inputs; i++) decoder.weights(l)[size_t(o) * decoder.stride(l) + i] = normal(random) * scale;
+    }
+    inputs = width;
+  }
+  std::vector<float> out(outputs);
+  float latent[2] = {0.0f, 0.0f}, check = 0.0f;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    latent[0] = -2.0f + 4.0f * (i % 97) / 96.0f;
+    decoder.decode(latent, out.data());
+    check += out[0];
+  }
+  decodeMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+  GridCache cache;
+  cache.build(decoder);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations * 100; i++) {
+    cache.lookup(15.0f * (i % 97) / 96.0f, 7.0f * (i % 89) / 88.0f, out.data());
+    check += out[0];
+  }
+  lookupMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (iterations * 100);
+  volatile float sink = check; // Keep the work from being optimized away.
+  (void)sink;
+}
@@ -0,0 +1,154 @@
+// Morph Scheduler:
+//
+// Moves many parameters from one state to the next, each over its own time and with its own easing.
+//
+// - Start, target, progress, rate and easing are kept in flat arrays, one entry per parameter, and
+//   advance() updates all of them in one pass with no branches, so the compiler vectorizes it and
+//   thousands of morphs cost a few microseconds a frame.
+// - Every easing is a cubic in the progress, stored as its three coefficients, so a parameter's
+//   easing is data rather than a branch.
+// - Parameters heard as ratios, like frequencies, can morph logarithmically: they're stored as
+//   log2 and converted back in a second pass over just those parameters.
+// - advance() takes seconds, so the same scheduler can run once per frame or once per audio block.
+//   Everything is allocated in setup().
+
+#pragma once
+
+#include <algorithm> // For std::min, std::max, std::find.
+#include <chrono> // For the benchmark.
+#include <cmath> // For std::log2, std::exp2, std::abs.
+#include <vector> // For the arrays.
+
+enum class Easing { Linear = 0, In, Out, Smooth, InCubic, OutCubic };
+
+class MorphScheduler {
+public:
+  // Allocate count parameters, all at rest at 0:
+  void setup(int count) {
+    mCount = count;
+    mStart.assign(count, 0.0f);
+    mTarget.assign(count, 0.0f);
+    mPosition.assign(count, 0.0f);
+    mValue.assign(count, 0.0f);
+    mProgress.assign(count, 1.0f);
+    mRate.assign(count, 0.0f);
+    mA.assign(count, 1.0f);
+    mB.assign(count, 0.0f);
+    mC.assign(count, 0.0f);
+    mChanged.assign(count, 0.0f);
+    mLog.assign(count, 0);
+    mLogIndices.clear();
+    mLogIndices.reserve(count);
+  }
+
+  int size() const { return mCount; }
+
+  // Set a parameter's value without morphing, and whether it morphs logarithmically. Values of a
+  // logarithmic parameter must be positive:
+  void define(int i, float value, bool logarithmic = false) {
+    if (logarithmic && !mLog[i]) mLogIndices.push_back(i);
+    if (!logarithmic && mLog[i]) mLogIndices.erase(std::find(mLogIndices.begin(), mLogIndices.end(), i)); // Back to linear.
+    mLog[i] = logarithmic ? 1 : 0;
+    jump(i, value);
+  }
+
+  // Set a parameter's value at once, stopping any morph:
+  void jump(int i, float value) {
+    float position = toDomain(i, value);
+    mStart[i] = mTarget[i] = mPosition[i] = position;
+    mValue[i] = value;
+    mProgress[i] = 1.0f;
+  }
+
+  // Morph a parameter from where it is to a target over some seconds:
+  void morph(int i, float target, float seconds, Easing easing = Easing::Smooth) {
+    mStart[i] = mPosition[i]; // From where it is, even mid-morph.
+    mTarget[i] = toDomain(i, target);
+    mProgress[i] = 0.0f;
+    mRate[i] = seconds > 0.0f ? 1.0f / seconds : 1e9f; // Zero seconds finishes on the next advance.
+    easingCoefficients(easing, mA[i], mB[i], mC[i]);
+  }
+
+  // Morph a parameter at a rate, in its units per second, or octaves per second when logarithmic:
+  void morphAtRate(int i, float target, float perSecond, Easing easing = Easing::Linear) {
+    float distance = std::abs(toDomain(i, target) - mPosition[i]);
+    morph(i, target, perSecond > 0.0f ? distance / perSecond : 0.0f, easing);
+  }
+
+  // Advance every morph by some seconds, in one pass:
+  void advance(float seconds) {
+    const int n = mCount;
+    float* start = mStart.data();
+    float* target = mTarget.data();
+    float* position = mPosition.data();
+    float* value = mValue.data();
+    float* progress = mProgress.data();
+    float* changed = mChanged.data();
+    const float* rate = mRate.data();
+    const float* a = mA.data();
+    const float* b = mB.data();
+    const float* c = mC.data();
+    for (int i = 0; i < n; i++) {
+      changed[i] = progress[i] < 1.0f ? 1.0f : 0.0f; // Moved in this pass, including the last step.
+      float t = std::min(progress[i] + rate[i] * seconds, 1.0f);
+      float eased = t * (a[i] + t * (b[i] + t * c[i]));
+      progress[i] = t;
+      position[i] = start[i] + (target[i] - start[i]) * eased;
+      value[i] = position[i];
+    }
+    for (int i : mLogIndices) value[i] = std::exp2(position[i]); // Back from octaves.
+  }
+
+  float value(int i) const { return mValue[i]; }
+  const float* values() const { return mValue.data(); }
+  bool moving(int i) const { return mProgress[i] < 1.0f; }
+  bool changed(int i) const { return mChanged[i] != 0.0f; } // Whether the last advance() moved it.
+
+  // Number of parameters still morphing:
+  int active() const {
+    int count = 0;
+    for (int i = 0; i < mCount; i++) count += mProgress[i] < 1.0f;
+    return count;
+  }
+
+private:
+  int mCount = 0;
+  std::vector<float> mStart, mTarget, mPosition; // In the parameter's domain, log2 when logarithmic.
+  std::vector<float> mValue; // The parameter's value.
+  std::vector<float> mProgress, mRate; // From 0 to 1, and per second.
+  std::vector<float> mA, mB, mC; // Easing cubic, eased = a t + b t^2 + c t^3.
+  std::vector<float> mChanged; // 1 where the last pass moved a parameter.
+  std::vector<char> mLog; // Whether each parameter morphs logarithmically.
+  std::vector<int> mLogIndices; // The logarithmic parameters.
+
+  float toDomain(int i, float value) const { return mLog[i] ? std::log2(std::max(value, 1e-12f)) : value; }
+
+  static void easingCoefficients(Easing easing, float& a, float& b, float& c) {
+    switch (easing) {
+      case Easing::In: a = 0.0f; b = 1.0f; c = 0.0f; break; // t^2.
+      case Easing::Out: a = 2.0f; b = -1.0f; c = 0.0f; break; // 1 - (1 - t)^2.
+      case Easing::Smooth: a = 0.0f; b = 3.0f; c = -2.0f; break; // Smoothstep.
+      case Easing::InCubic: a = 0.0f; b = 0.0f; c = 1.0f; break; // t^3.
+      case Easing::OutCubic: a = 3.0f; b = -3.0f; c = 1.0f; break; // 1 - (1 - t)^3.
+      default: a = 1.0f; b = 0.0f; c = 0.0f; break; // Linear.
+    }
+  }
+};
+
+// Morph a number of parameters at once, returns microseconds per advance():
+inline double benchmarkMorphScheduler(int count, int iterations = 2000) {
+  MorphScheduler morphs;
+  morphs.setup(count);
+  for (int i = 0; i < count; i++) morphs.define(i, 1.0f + i % 7, i % 4 == 0); // A quarter of them logarithmic.
+  float check = 0.0f;
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < iterations; n++) {
+    if (n % 60 == 0) { // A new state every second at 60 frames per second.
+      for (int i = 0; i < count; i++) morphs.morph(i, 1.0f + (i + n) % 11, 0.5f + 0.1f * (i % 5), Easing(i % 6));
+    }
+    morphs.advance(1.0f / 60.0f);
+    check += morphs.value(n % count);
+  }
+  double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+  return check == -1.0f ? 0.0 : micros; // Keep the work from being optimized away.
+}
@@ -0,0 +1,99 @@
+// Parameter Handoff:
+//
+// Moves synth parameters computed on the animation thread to the audio thread.
+//
+// - TripleBuffer hands over whole snapshots. The writer fills the back buffer and publishes it,
+//   and the reader picks up the most recent published snapshot. Neither side ever waits or
+//   allocates. When the writer publishes faster than the reader reads, older snapshots are
+//   simply skipped, so a flood of GUI or OSC changes can't back anything up.
+// - ParamSmoother eases each value toward the latest snapshot on the audio thread. It
+//   gives sample-accurate curves, or the value at the end of a block for linear ramps.
+
+#pragma once
+
+#include <atomic> // For the shared buffer index.
+#include <cmath> // For std::exp, std::pow.
+#include <vector> // For the smoother's values.
+
+template <class T>
+class TripleBuffer {
+public:
+  // The buffer the writer fills. Writer thread only:
+  T& back() { return mBuffers[mBack]; }
+
+  // Publish the back buffer and take the previous shared buffer as the new back buffer. Writer thread only:
+  void publish() {
+    int old = mShared.exchange(mBack | freshBit, std::memory_order_acq_rel);
+    mBack = old & indexMask;
+  }
+
+  // Copy a snapshot in and publish it. Writer thread only:
+  void write(const T& value) {
+    back() = value;
+    publish();
+  }
+
+  // Take the latest published snapshot if there is a new one, returns false otherwise. Reader thread only:
+  bool update() {
+    if (!(mShared.load(std::memory_order_relaxed) & freshBit)) return false; // Nothing new.
+    int old = mShared.exchange(mFront, std::memory_order_acq_rel);
+    mFront = old & indexMask;
+    return true;
+  }
+
+  // The latest snapshot taken by update(). Reader thread only:
+  const T& front() const { return mBuffers[mFront]; }
+
+private:
+  static const int indexMask = 3; // The low bits hold the index of the shared buffer.
+  static const int freshBit = 4; // Set when the shared buffer holds a snapshot the reader hasn't taken.
+  T mBuffers[3] = {};
+  std::atomic<int> mShared{1}; // The buffer in the middle, owned by neither side.
+  int mBack = 0; // Owned by the writer.
+  int mFront = 2; // Owned by the reader.
+};
+
+// Exponential smoothing of a set of values toward their targets, for the audio thread:
+class ParamSmoother {
+public:
+  // Allocate every value, call before the audio thread starts:
+  void setup(int count, double sampleRate, double smoothingSeconds = 0.02) {
+    mValue.assign(count, 0.0f);
+    mTarget.assign(count, 0.0f);
+    mSet.assign(count, false);
+    mCoefficient = float(std::exp(-1.0 / (smoothingSeconds * sampleRate))); // Per sample decay toward the target.
+  }
+
+  // Set a target. The first target set is jumped to, so nothing sweeps in from zero:
+  void target(int i, float value) {
+    mTarget[i] = value;
+    if (!mSet[i]) {
+      mValue[i] = value;
+      mSet[i] = true;
+    }
+  }
+
+  float value(int i) const { return mValue[i]; }
+
+  // Advance one value by a block and return its value at the end, for a linear ramp across the block:
+  float advance(int i, int frames) {
+    float decay = float(std::pow(mCoefficient, frames));
+    mValue[i] = mTarget[i] + (mValue[i] - mTarget[i]) * decay;
+    return mValue[i];
+  }
+
+  // Advance one value by a block and write its curve sample by sample:
+  void process(int i, float* out, int frames) {
+    float v = mValue[i], t = mTarget[i];
+    for (int n = 0; n < frames; n++) {
+      v = t + (v - t) * mCoefficient;
+      out[n] = v;
+    }
+    mValue[i] = v;
+  }
+
+private:
+  std::vector<float> mValue, mTarget; // Current values and their targets.
+  std::vector<bool> mSet; // Whether a target has been set yet.
+  float mCoefficient = 0.0f;
+};
@@ -0,0 +1,118 @@
+// Resolution Controller:
+//
+// Chooses the internal resolution scale of the raymarch pass from its measured time.
+// This has no graphics dependencies so it can be stepped with fake frame times on the CPU.
+//
+// Feed it the GPU time of the pass, not the frame time: with vsync on, the frame time never drops
+// below the refresh period, so after scaling down it would never see the room to climb back up.
+//
+// - The cost of the raymarch pass is roughly proportional to the number of pixels, so the
+//   scale needed to hit the budget is estimated as scale * sqrt(budget / frameTime).
+// - The scale is quantized to fixed steps so the render targets are not reallocated every frame.
+// - After each change the controller waits a number of frames for the new cost to settle.
+// - The scale only climbs when the predicted cost of the next step fits the budget, so it doesn't oscillate.
+
+#pragma once
+
+#include <algorithm> // For std::min, std::max.
+#include <cmath> // For std::sqrt, std::floor, std::ceil.
+
+struct ResolutionController {
+  // Settings:
+  double targetFrameTime = 1.0 / 60.0; // The time budget of the pass in seconds.
+  float minScale = 0.25f; // The lowest internal resolution scale.
+  float maxScale = 1.0f; // The highest internal resolution scale (native resolution).
+  float scaleStep = 0.125f; // The scale is quantized to multiples of this step.
+  double smoothing = 0.1; // Coefficient of the exponential moving average of the frame time.
+  double overBudget = 1.05; // Scale down when the average frame time exceeds the budget by this ratio.
+  double underBudget = 0.95; // Scale up when the predicted frame time at the next step stays below the budget by this ratio.
+  int settleFrames = 15; // Frames to wait after a change before changing again.
+
+  // State:
+  float scale = 1.0f; // The current internal resolution scale.
+  double averageFrameTime = 0.0; // Exponential moving average of the frame time.
+  int framesSinceChange = 0; // Frames since the scale last changed.
+
+  // Reset the controller to native resolution:
+  void reset() {
+    scale = maxScale; // Start at the highest scale.
+    averageFrameTime = 0.0; // Forget the measured frame times.
+    framesSinceChange = 0; // Restart the settle period.
+  }
+
+  // Set the budget from a target frame rate:
+  void targetFps(double fps) {
+    targetFrameTime = 1.0 / std::max(fps, 1.0);
+  }
+
+  // Feed the duration of the last measured pass, returns true when the scale has changed:
+  bool update(double frameTime) {
+    if (frameTime <= 0.0) return false; // Ignore invalid measurements.
+    if (averageFrameTime <= 0.0) { // If this is the first measurement...
+      averageFrameTime = frameTime; // Seed the average with it.
+    } else {
+      averageFrameTime += smoothing * (frameTime - averageFrameTime); // Smooth out single slow frames.
+    }
+    if (++framesSinceChange < settleFrames) return false; // Let the previous change settle.
+
+    float next = scale;
+    if (averageFrameTime > targetFrameTime * overBudget) { // If we are over budget...
+      float estimate = scale * float(std::sqrt(targetFrameTime / averageFrameTime)); // Pixel count scales with the square of the scale.
+      next = quantizeDown(std::min(estimate, scale - scaleStep)); // Always drop by at least one step.
+    } else if (scale < maxScale) { // If there is room to climb...
+      float up = scale + scaleStep; // Climb back up one step at a time.
+      double predicted = averageFrameTime * (up / scale) * (up / scale); // Expected frame time at the next step.
+      if (predicted < targetFrameTime * underBudget) next = up; // Only if it would stay within budget, to avoid oscillating.
+    }
+    next = std::min(std::max(next, minScale), maxScale); // Keep within the allowed range.
+
+    if (next == scale) return false; // Nothing to do.
+    scale = next; // Apply the new scale.
+    framesSinceChange = 0; // Restart the settle period.
+    averageFrameTime = targetFrameTime; // The old measurements no longer apply.
+    return true;
+  }
+
+  // Size of the internal render target for a given output size:
+  int scaled(int size) const {
+    return std::max(1, int(size * scale + 0.5f));
+  }
+
+  // Round a scale down to the nearest step:
+  float quantizeDown(float s) const {
+    return std::floor(s / scaleStep + 1e-4f) * scaleStep;
+  }
+};
+
+// Radical inverse in the given base, used for the sub-pixel jitter sequence:
+inline float halton(int index, int base) {
+  float f = 1.0f, r = 0.0f;
+  while (index > 0) {
+    f /= float(base);
+    r += f * float(index % base);
+    index /= base;
+  }
+  return r;
+}
+
+// Step two controllers through a synthetic run with vsync at 60 Hz: a pass that costs 12 ms at
+// native resolution, with a burst of frames four times slower. One is fed the pass time and one
+// the frame time, rounded up to whole refresh periods. Returns whether the first climbs back to
+// native resolution, and the final scale of each:
+inline bool checkResolutionRecovery(float& fromPass, float& fromFrame) {
+  ResolutionController pass, frame;
+  pass.reset();
+  frame.reset();
+  const double refresh = 1.0 / 60.0, nativeCost = 0.012;
+  for (int i = 0; i < 1200; i++) { // Twenty seconds.
+    double slowdown = i >= 120 && i < 150 ? 4.0 : 1.0; // Half a second of something else on the GPU.
+    for (ResolutionController* controller : {&pass, &frame}) {
+      double passTime = nativeCost * slowdown * controller->scale * controller->scale; // Cost follows the pixel count.
+      double frameTime = std::ceil(passTime / refresh - 1e-9) * refresh; // Waits for the next vsync.
+      controller->update(controller == &pass ? passTime : frameTime);
+    }
+  }
+  fromPass = pass.scale;
+  fromFrame = frame.scale;
+  return pass.scale == pass.maxScale;
+}
@@ -0,0 +1,255 @@
+// Reverb:
+//
+// Distance cues for every cluster, with a single late reverb shared by all of them.
+//
+// - VoiceFilters runs a cascade of biquads on each voice, e.g. a lowpass for air absorption and a
+//   high shelf cut that both grow with distance. The voices are interleaved so the inner loop runs
+//   across voices instead of along each voice's recursion, which the compiler vectorizes.
+// - EarlyReflections adds a few delayed taps of each voice to itself, and accumulates each voice,
+//   scaled by its send level, into one reverb input. Farther voices send more.
+// - FdnReverb is an eight line feedback delay network with a Hadamard mixing matrix and damping
+//   in the loop. It runs once no matter how many voices feed it, and spreads its lines over
+//   every speaker, so the cost per cluster stays small as clusters are added.
+//
+// Everything is allocated in setup(), nothing allocates on the audio thread.
+
+#pragma once
+
+#include <algorithm> // For std::min, std::max, std::fill.
+#include <chrono> // For the benchmark.
+#include <cmath> // For std::cos, std::sin, std::pow, std::sqrt, std::exp.
+#include <vector> // For the buffers.
+
+class VoiceFilters {
+public:
+  // Allocate every buffer, call before the audio thread starts. Every stage starts out as a pass through:
+  void setup(int maxVoices, int blockSize, double sampleRate, int stages = 2) {
+    mVoices = maxVoices;
+    mStages = stages;
+    mSampleRate = sampleRate;
+    size_t size = size_t(stages) * maxVoices;
+    mB0.assign(size, 1.0f);
+    mB1.assign(size, 0.0f);
+    mB2.assign(size, 0.0f);
+    mA1.assign(size, 0.0f);
+    mA2.assign(size, 0.0f);
+    mZ1.assign(size, 0.0f);
+    mZ2.assign(size, 0.0f);
+    mInterleaved.assign(size_t(blockSize) * maxVoices, 0.0f);
+    mBlockSize = blockSize;
+  }
+
+  // Set a stage of a voice to a lowpass:
+  void lowpass(int stage, int voice, float hz, float q = 0.7071f) {
+    double w = 2.0 * M_PI * std::min(double(hz), 0.49 * mSampleRate) / mSampleRate;
+    double alpha = std::sin(w) / (2.0 * q), cosw = std::cos(w);
+    set(stage, voice, (1.0 - cosw) / 2.0, 1.0 - cosw, (1.0 - cosw) / 2.0, 1.0 + alpha, -2.0 * cosw, 1.0 - alpha);
+  }
+
+  // Set a stage of a voice to a high shelf, boosting or cutting above hz:
+  void highShelf(int stage, int voice, float hz, float gainDb) {
+    double a = std::pow(10.0, gainDb / 40.0);
+    double w = 2.0 * M_PI * std::min(double(hz), 0.49 * mSampleRate) / mSampleRate;
+    double cosw = std::cos(w), beta = 2.0 * std::sqrt(a) * std::sin(w) / std::sqrt(2.0); // Shelf slope of 1.
+    set(stage, voice,
+      a * ((a + 1.0) + (a - 1.0) * cosw + beta), -2.0 * a * ((a - 1.0) + (a + 1.0) * cosw), a * ((a + 1.0) + (a - 1.0) * cosw - beta),
+      (a + 1.0) - (a - 1.0) * cosw + beta, 2.0 * ((a - 1.0) - (a + 1.0) * cosw), (a + 1.0) - (a - 1.0) * cosw - beta);
+  }
+
+  // Filter a block of each voice in place:
+  void process(float* const* blocks, int voices, int frames) {
+    voices = std::min(voices, mVoices);
+    frames = std::min(frames, mBlockSize);
+    float* x = mInterleaved.data();
+    for (int v = 0; v < voices; v++) { // Interleave, so each sample of every voice is contiguous.
+      for (int i = 0; i < frames; i++) x[i * voices + v] = blocks[v][i];
+    }
+    for (int s = 0; s < mStages; s++) {
+      size_t o = size_t(s) * mVoices;
+      const float *b0 = &mB0[o], *b1 = &mB1[o], *b2 = &mB2[o], *a1 = &mA1[o], *a2 = &mA2[o];
+      float *z1 = &mZ1[o], *z2 = &mZ2[o];
+      for (int i = 0; i < frames; i++) {
+        float* frame = x + i * voices;
+        for (int v = 0; v < voices; v++) { // Transposed direct form II, across voices.
+          float in = frame[v];
+          float out = b0[v] * in + z1[v];
+          z1[v] = b1[v] * in - a1[v] * out + z2[v];
+          z2[v] = b2[v] * in - a2[v] * out;
+          frame[v] = out;
+        }
+      }
+    }
+    for (int v = 0; v < voices; v++) {
+      for (int i = 0; i < frames; i++) blocks[v][i] = x[i * voices + v];
+    }
+  }
+
+private:
+  int mVoices = 0, mStages = 0, mBlockSize = 0;
+  double mSampleRate = 44100.0;
+  std::vector<float> mB0, mB1, mB2, mA1, mA2; // Coefficients, stage by voice, normalized by a0.
+  std::vector<float> mZ1, mZ2; // Filter state, stage by voice.
+  std::vector<float> mInterleaved; // Sample by voice.
+
+  void set(int stage, int voice, double b0, double b1, double b2, double a0, double a1, double a2) {
+    size_t i = size_t(stage) * mVoices + voice;
+    mB0[i] = float(b0 / a0);
+    mB1[i] = float(b1 / a0);
+    mB2[i] = float(b2 / a0);
+    mA1[i] = float(a1 / a0);
+    mA2[i] = float(a2 / a0);
+  }
+};
+
+class EarlyReflections {
+public:
+  static const int taps = 6; // Reflections per voice.
+
+  // Allocate every buffer, call before the audio thread starts. roomScale stretches the reflection times:
+  void setup(int maxVoices, double sampleRate, float roomScale = 1.0f) {
+    mVoices = maxVoices;
+    mLines.assign(size_t(maxVoices) * lineLength, 0.0f);
+    mWrite.assign(maxVoices, 0);
+    mDelay.resize(size_t(maxVoices) * taps);
+    mGain.resize(size_t(maxVoices) * taps);
+    const float times[taps] = {7.1f, 11.3f, 17.9f, 23.7f, 31.3f, 41.9f}; // Milliseconds, spread so they don't line up.
+    for (int v = 0; v < maxVoices; v++) {
+      float spread = 1.0f + 0.06f * float((v * 7) % 5) / 4.0f; // Slightly different rooms per voice, so they decorrelate.
+      for (int t = 0; t < taps; t++) {
+        int delay = int(times[t] * roomScale * spread * sampleRate / 1000.0);
+        mDelay[size_t(v) * taps + t] = std::min(std::max(delay, 1), lineLength - 1);
+        mGain[size_t(v) * taps + t] = 0.5f * std::pow(0.75f, float(t)) * ((t & 1) ? -1.0f : 1.0f); // Decaying, alternating sign.
+      }
+    }
+  }
+
+  // Add the reflections to each voice in place, and add each voice times its send into reverbIn:
+  void process(float* const* blocks, int voices, int frames, const float* sends, float* reverbIn) {
+    voices = std::min(voices, mVoices);
+    for (int v = 0; v < voices; v++) {
+      float* block = blocks[v];
+      float* line = &mLines[size_t(v) * lineLength];
+      int write = mWrite[v];
+      for (int i = 0; i < frames; i++) line[(write + i) & mask] = block[i]; // Write the dry block first, every tap is at least a sample back.
+      for (int t = 0; t < taps; t++) {
+        int read = write - mDelay[size_t(v) * taps + t];
+        float gain = mGain[size_t(v) * taps + t];
+        for (int i = 0; i < frames; i++) block[i] += gain * line[(read + i) & mask];
+      }
+      mWrite[v] = (write + frames) & mask;
+      float send = sends[v];
+      for (int i = 0; i < frames; i++) reverbIn[i] += send * block[i];
+    }
+  }
+
+private:
+  static const int lineLength = 8192; // A power of two, over 180 ms at 44.1 kHz.
+  static const int mask = lineLength - 1;
+  int mVoices = 0;
+  std::vector<float> mLines; // One delay line per voice.
+  std::vector<int> mWrite; // Write position of each line.
+  std::vector<int> mDelay; // Voice by tap, in samples.
+  std::vector<float> mGain; // Voice by tap.
+};
+
+class FdnReverb {
+public:
+  static const int lines = 8;
+
+  // Allocate every buffer, call before the audio thread starts:
+  void setup(double sampleRate, float decaySeconds = 2.5f, float dampingHz = 5000.0f) {
+    mSampleRate = sampleRate;
+    const int primes[lines] = {1031, 1327, 1523, 1801, 2053, 2311, 2579, 2819}; // Mutually prime lengths at 44.1 kHz.
+    int length = 1;
+    for (int l = 0; l < lines; l++) {
+      mDelay[l] = std::max(1, int(primes[l] * sampleRate / 44100.0));
+      while (length <= mDelay[l]) length *= 2;
+    }
+    mLength = length;
+    mLines.assign(size_t(lines) * length, 0.0f);
+    mWrite = 0;
+    for (float& s : mDamped) s = 0.0f;
+    mDamping = float(std::exp(-2.0 * M_PI * dampingHz / sampleRate)); // One pole lowpass in each loop.
+    decay(decaySeconds);
+  }
+
+  // Set the time it takes to decay by 60 dB:
+  void decay(float seconds) {
+    seconds = std::max(seconds, 0.05f);
+    for (int l = 0; l < lines; l++) mFeedback[l] = float(std::pow(10.0, -3.0 * mDelay[l] / (seconds * mSampleRate)));
+  }
+
+  // Run a block of the shared input through the network and add it to every output, spreading the lines over them:
+  void process(const float* in, float* const* out, int outputs, int frames, float gain = 1.0f) {
+    size_t mask = size_t(mLength) - 1;
+    float scale = gain / std::sqrt(std::max(1.0f, outputs / float(lines))); // Keep the level similar for any number of outputs.
+    for (int i = 0; i < frames; i++) {
+      float y[lines];
+      for (int l = 0; l < lines; l++) { // Read and damp each line.
+        float tap = mLines[size_t(l) * mLength + ((mWrite - mDelay[l]) & mask)];
+        mDamped[l] = tap + mDamping * (mDamped[l] - tap);
+        y[l] = mDamped[l];
+      }
+      for (int m = 0; m < outputs; m++) out[m][i] += scale * ((m / lines) & 1 ? -y[m % lines] : y[m % lines]); // Flip the sign every eight outputs, so repeated lines decorrelate.
+      hadamard(y); // Mix the lines, losslessly.
+      for (int l = 0; l < lines; l++) mLines[size_t(l) * mLength + (mWrite & mask)] = in[i] + mFeedback[l] * y[l];
+      mWrite = (mWrite + 1) & mask;
+    }
+  }
+
+private:
+  double mSampleRate = 44100.0;
+  int mDelay[lines] = {};
+  float mFeedback[lines] = {};
+  float mDamped[lines] = {}; // State of the damping filters.
+  float mDamping = 0.0f;
+  int mLength = 0; // Length of each line, a power of two.
+  size_t mWrite = 0;
+  std::vector<float> mLines;
+
+  // Normalized 8 point Hadamard transform, an orthogonal mixing matrix:
+  static void hadamard(float* y) {
+    for (int h = 1; h < lines; h *= 2) {
+      for (int i = 0; i < lines; i += 2 * h) {
+        for (int j = i; j < i + h; j++) {
+          float a = y[j], b = y[j + h];
+          y[j] = a + b;
+          y[j + h] = a - b;
+        }
+      }
+    }
+    for (int l = 0; l < lines; l++) y[l] *= 0.35355339f; // 1 / sqrt(8).
+  }
+};
+
+// Run a number of voices through the filters and early reflections into the shared reverb for a number
+// of seconds, returns how many times faster than real time it ran:
+inline double benchmarkReverb(int voices, double seconds = 10.0, int blockSize = 512, double sampleRate = 44100.0, int outputs = 2) {
+  VoiceFilters filters;
+  filters.setup(voices, blockSize, sampleRate);
+  EarlyReflections reflections;
+  reflections.setup(voices, sampleRate);
+  FdnReverb reverb;
+  reverb.setup(sampleRate);
+  std::vector<float> blocks(size_t(voices) * blockSize), speakers(size_t(outputs) * blockSize), reverbIn(blockSize);
+  std::vector<float*> in(voices), out(outputs);
+  std::vector<float> sends(voices, 0.3f);
+  for (int v = 0; v < voices; v++) {
+    in[v] = &blocks[size_t(v) * blockSize];
+    filters.lowpass(0, v, 2000.0f + 100.0f * v);
+    filters.highShelf(1, v, 4000.0f, -6.0f);
+  }
+  for (int o = 0; o < outputs; o++) out[o] = &speakers[size_t(o) * blockSize];
+  int blocksToRun = int(seconds * sampleRate / blockSize);
+  auto start = std::chrono::steady_clock::now();
+  for (int b = 0; b < blocksToRun; b++) {
+    for (int v = 0; v < voices; v++) std::fill(in[v], in[v] + blockSize, (b + v) & 1 ? 0.1f : -0.1f); // Something to filter.
+    filters.process(in.data(), voices, blockSize);
+    std::fill(reverbIn.begin(), reverbIn.end(), 0.0f);
+    reflections.process(in.data(), voices, blockSize, sends.data(), reverbIn.data());
+    for (int o = 0; o < outputs; o++) std::fill(out[o], out[o] + blockSize, 0.0f);
+    reverb.process(reverbIn.data(), out.data(), outputs, blockSize);
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return seconds / elapsed;
+}
@@ -0,0 +1,51 @@
+// Scene SDF:
+//
+// CPU versions of the signed distance functions in shaders/scene.glsl, which clusters.frag and
+// clustersStereo.frag both include, used for baking the distance volume and for checking the
+// shaders' output against a reference on the CPU. Keep these in sync with scene.glsl.
+
+#pragma once
+
+#include "al/math/al_Vec.hpp" // Vectors.
+#include <cmath> // For std::exp2, std::log2.
+#include <vector> // For the cache key.
+
+// Signed distance field formula for a sphere:
+inline float sphereSDF(const al::Vec3f& center, float radius, const al::Vec3f& toPoint) {
+  return (center - toPoint).mag() - radius;
+}
+
+// A cluster of metaballs blended with an exponential smooth minimum, in cluster local space:
+struct MetaballCluster {
+  static const int count = 4; // Number of metaballs in the cluster.
+  al::Vec3f offsets[count] = { // Position of each metaball relative to the cluster.
+    al::Vec3f(-0.5f, 0.0f, 0.0f), // Sphere one.
+    al::Vec3f(0.5f, 0.0f, 0.0f), // Sphere two.
+    al::Vec3f(0.0f, 0.5f, 0.0f), // Sphere three.
+    al::Vec3f(0.0f, -0.5f, 0.0f) // Sphere four.
+  };
+  float radii[count] = {0.5f, 0.1f, 0.1f, 0.2f}; // Radius of each metaball.
+  float k = 8.0f; // The smoothness coefficient of the minimum.
+
+  // Distance from a point relative to the cluster center:
+  float distance(const al::Vec3f& p) const {
+    float res = 0.0f;
+    for (int i = 0; i < count; i++) {
+      res += std::exp2(-k * sphereSDF(offsets[i], radii[i], p)); // Accumulate the smooth minimum.
+    }
+    return -std::log2(res) / k; // Total distance.
+  }
+
+  // Every parameter that changes the shape, used to key baked volumes:
+  std::vector<float> key() const {
+    std::vector<float> key;
+    for (int i = 0; i < count; i++) {
+      key.push_back(offsets[i].x);
+      key.push_back(offsets[i].y);
+      key.push_back(offsets[i].z);
+      key.push_back(radii[i]);
+    }
+    key.push_back(k);
+    return key;
+  }
+};
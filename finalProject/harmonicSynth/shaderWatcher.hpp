@@ -0,0 +1,254 @@
+// Shader Watcher:
+//
+// Hot reloads shader programs without blocking the render thread.
+//
+// - A watcher thread waits for file change notifications (inotify on Linux, polling the
+//   modification times elsewhere) for every shader file and every file they #include.
+// - When a file changes, the watcher thread re-reads the sources of the programs using it,
+//   resolves their #include directives and queues the preprocessed sources.
+// - The render thread calls update() once per frame. It never waits for the queue, and compiles
+//   queued sources into a spare program. The live program is only swapped after a successful
+//   compile, so a broken edit leaves the last working program bound.
+
+#pragma once
+
+#include "al/graphics/al_Shader.hpp" // Shader programs.
+#include "al/io/al_File.hpp" // Search paths.
+#include <atomic> // For the stop flag.
+#include <chrono> // For the polling interval.
+#include <cstdio> // For printf.
+#include <cstring> // For strlen.
+#include <fstream> // For reading the sources.
+#include <map> // For the dependencies of each file.
+#include <memory> // For std::unique_ptr.
+#include <mutex> // For the queue.
+#include <set> // For the files each program depends on.
+#include <sstream> // For reading the sources.
+#include <string> // For paths and sources.
+#include <thread> // For the watcher thread.
+#include <vector> // For the programs.
+
+#ifdef __linux__
+#include <poll.h> // For waiting on the inotify descriptor with a timeout.
+#include <sys/inotify.h> // For file change notifications.
+#include <unistd.h> // For read and close.
+#else
+#include <sys/stat.h> // For the modification times when polling.
+#endif
+
+// A shader program with a spare to compile into, so the live program is only replaced by one that works:
+struct ShaderSlot {
+  al::ShaderProgram programs[2]; // The live program and the spare.
+  int current = 0; // Index of the live program.
+  std::string vertName, fragName; // The shader files, as given to the search paths.
+
+  al::ShaderProgram& live() { return programs[current]; }
+
+  // Compile new sources into the spare program and swap it in if it works:
+  bool compile(const std::string& vert, const std::string& frag) {
+    al::ShaderProgram& spare = programs[1 - current];
+    if (!spare.compile(vert, frag)) return false; // Keep the live program.
+    current = 1 - current; // Swap.
+    return true;
+  }
+};
+
+class ShaderWatcher {
+public:
+  ~ShaderWatcher() { stop(); }
+
+  // The search paths used to find shader files and includes. They must not change after start().
+  void searchPaths(al::SearchPaths* paths) { mSearchPaths = paths; }
+
+  // Load a program now and watch its files for changes. Call before start(), from the render thread:
+  bool add(ShaderSlot& slot, const std::string& vertName, const std::string& fragName) {
+    slot.vertName = vertName;
+    slot.fragName = fragName;
+    Source source = preprocess(slot); // Read the sources.
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mSlots.push_back(&slot);
+      mDependencies[&slot] = source.files; // Remember which files to watch.
+    }
+    return slot.compile(source.vert, source.frag); // Compile right away.
+  }
+
+  // Start the watcher thread:
+  void start() {
+    if (mThread.joinable()) return; // Already running.
+    mRunning = true;
+    mThread = std::thread([this]() { watch(); });
+  }
+
+  // Stop the watcher thread:
+  void stop() {
+    mRunning = false;
+    if (mThread.joinable()) mThread.join();
+  }
+
+  // Compile any queued sources. Call once per frame from the render thread, never blocks on the watcher:
+  void update() {
+    std::vector<Source> pending;
+    {
+      std::unique_lock<std::mutex> lock(mMutex, std::try_to_lock); // Skip this frame if the watcher holds the queue.
+      if (!lock.owns_lock() || mPending.empty()) return;
+      pending.swap(mPending); // Take the queue.
+    }
+    for (Source& source : pending) {
+      if (source.slot->compile(source.vert, source.frag)) {
+        printf("shader reloaded: %s, %s\n", source.slot->vertName.c_str(), source.slot->fragName.c_str());
+      } else {
+        printf("shader failed to compile, keeping the last working program: %s, %s\n", source.slot->vertName.c_str(), source.slot->fragName.c_str());
+      }
+    }
+  }
+
+private:
+  // Preprocessed sources of a program, and every file they were read from:
+  struct Source {
+    ShaderSlot* slot = nullptr;
+    std::string vert, frag;
+    std::set<std::string> files;
+  };
+
+  al::SearchPaths* mSearchPaths = nullptr;
+  std::vector<ShaderSlot*> mSlots; // Every watched program.
+  std::map<ShaderSlot*, std::set<std::string>> mDependencies; // The files each program was read from.
+  std::vector<Source> mPending; // Sources waiting to be compiled on the render thread.
+  std::mutex mMutex; // Guards mSlots, mDependencies and mPending.
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+
+  // Full path of a shader file:
+  std::string find(const std::string& name) {
+    return mSearchPaths ? mSearchPaths->find(name).filepath() : name;
+  }
+
+  static std::string readFile(const std::string& path) {
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  // Read a shader file and replace its #include directive with the included file:
+  std::string readGlsl(const std::string& name, std::set<std::string>& files) {
+    std::string path = find(name);
+    files.insert(path);
+    std::string code = readFile(path);
+    size_t from = code.find("#include \""); // Find the include directive.
+    if (from != std::string::npos) { // If the include directive is found...
+      size_t capture = from + strlen("#include \""); // Begin capturing the filename.
+      size_t to = code.find("\"", capture); // End the filename.
+      std::string includePath = find(code.substr(capture, to - capture));
+      files.insert(includePath); // Watch the included file too.
+      code = code.replace(from, to - from + 2, readFile(includePath)); // Replace the directive with the file.
+    }
+    return code;
+  }
+
+  Source preprocess(ShaderSlot& slot) {
+    Source source;
+    source.slot = &slot;
+    source.vert = readGlsl(slot.vertName, source.files);
+    source.frag = readGlsl(slot.fragName, source.files);
+    return source;
+  }
+
+  // Re-read every program that depends on a changed file and queue it:
+  void changed(const std::set<std::string>& paths) {
+    std::vector<ShaderSlot*> slots;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for (ShaderSlot* slot : mSlots) {
+        for (const std::string& path : paths) {
+          if (mDependencies[slot].count(path)) {
+            slots.push_back(slot);
+            break;
+          }
+        }
+      }
+    }
+    for (ShaderSlot* slot : slots) {
+      Source source = preprocess(*slot); // Read off the render thread.
+      std::lock_guard<std::mutex> lock(mMutex);
+      mDependencies[slot] = source.files; // The includes may have changed.
+      for (auto i = mPending.begin(); i != mPending.end(); ++i) {
+        if (i->slot == slot) { // Drop older sources for the same program.
+          mPending.erase(i);
+          break;
+        }
+      }
+      mPending.push_back(std::move(source));
+    }
+  }
+
+  // Every file currently watched:
+  std::set<std::string> watchedFiles() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::set<std::string> files;
+    for (auto& dependency : mDependencies) files.insert(dependency.second.begin(), dependency.second.end());
+    return files;
+  }
+
+  static std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+  }
+
+#ifdef __linux__
+  // Watch the directories of the shader files, editors often replace a file instead of writing to it:
+  void watch() {
+    int fd = inotify_init1(IN_NONBLOCK);
+    if (fd < 0) return;
+    std::map<int, std::string> directories; // Watch descriptor to directory.
+    auto addWatches = [&]() {
+      for (const std::string& file : watchedFiles()) {
+        std::string dir = directoryOf(file);
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE); // Returns the same descriptor for a directory already watched.
+        if (wd >= 0) directories[wd] = dir;
+      }
+    };
+    addWatches();
+
+    alignas(struct inotify_event) char buffer[4096];
+    while (mRunning) {
+      pollfd pfd{fd, POLLIN, 0};
+      if (poll(&pfd, 1, 100) <= 0) continue; // Wake up regularly to check the stop flag.
+      std::set<std::string> paths;
+      ssize_t length;
+      while ((length = read(fd, buffer, sizeof(buffer))) > 0) { // Drain every queued event.
+        for (char* p = buffer; p < buffer + length;) {
+          auto* event = reinterpret_cast<struct inotify_event*>(p);
+          if (event->len > 0 && directories.count(event->wd)) {
+            paths.insert(directories[event->wd] + "/" + event->name);
+          }
+          p += sizeof(struct inotify_event) + event->len;
+        }
+      }
+      if (!paths.empty()) {
+        changed(paths);
+        addWatches(); // A new include may live in another directory.
+      }
+    }
+    close(fd);
+  }
+#else
+  // Without inotify, poll the modification times on the watcher thread instead:
+  void watch() {
+    std::map<std::string, time_t> modified;
+    while (mRunning) {
+      std::set<std::string> paths;
+      for (const std::string& file : watchedFiles()) {
+        struct stat info;
+        if (stat(file.c_str(), &info) != 0) continue;
+        auto found = modified.find(file);
+        if (found != modified.end() && found->second != info.st_mtime) paths.insert(file);
+        modified[file] = info.st_mtime;
+      }
+      if (!paths.empty()) changed(paths);
+      std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+  }
+#endif
+};
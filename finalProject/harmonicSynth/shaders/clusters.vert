@@ -6,6 +6,7 @@ uniform mat4 al_ViewMatrixInv;
 uniform mat4 al_ProjMatrixInv;
 uniform float eye_sep;
 uniform float foc_len;
+uniform vec2 jitter; // Sub-pixel offset for dynamic resolution, zero otherwise.
 
 layout (location = 0) in vec3 position;
 
@@ -16,7 +17,7 @@ void main()
   gl_Position = vec4(position.xy, -1., 1.);
 
   mat4 ivp = al_ModelMatrixInv * al_ViewMatrixInv * al_ProjMatrixInv;
-  vec4 worldspace_near = ivp * vec4(position.xy, -1., 1.);
+  vec4 worldspace_near = ivp * vec4(position.xy + jitter, -1., 1.);
   vec4 worldspace_far = worldspace_near + ivp[2];
   worldspace_far /= worldspace_far.w;
   worldspace_near /= worldspace_near.w;
@@ -0,0 +1,61 @@
+#version 330
+
+// Single pass stereo: traces the left eye, and on the way finds how much of the right eye's ray
+// is certainly empty, so the right eye's march starts after it instead of at the bounding box.
+// stereoTracer.hpp checks the right eye against a separate pass on the CPU.
+
+#include "scene.glsl"
+
+// Variables from the Vertex Shader:
+in vec3 ray_dir_l, ray_origin_l; // The ray of the left eye.
+in vec3 ray_dir_r, ray_origin_r; // The ray of the right eye.
+
+layout (location = 0) out vec4 frag_out0; // The left eye color, with the hit distance in alpha.
+layout (location = 1) out vec4 frag_out1; // The right eye color, with the hit distance in alpha.
+
+// March the left eye exactly as trace() does, and return in right_start where the
+// right eye's march can begin. A left sample a distance d from the scene keeps the right ray empty
+// within d - separation - hitSurf of the same distance along it, so the right eye starts at its
+// last step before the first gap in those stretches:
+vec4 traceLeft(out float right_start) {
+  vec3 slice_min = box_min + clusterPos; // The bounding box, around the cluster.
+  vec3 slice_max = box_max + clusterPos;
+
+  vec3 boxHit_r = rayBoxIntersect(slice_min, slice_max, ray_origin_r, ray_dir_r);
+  right_start = max(boxHit_r.y, 0.0); // Where the right eye's own pass would start...
+  float clear = right_start; // ...and how far its ray is proven empty.
+
+  vec3 boxHit = rayBoxIntersect(slice_min, slice_max, ray_origin_l, ray_dir_l);
+  vec4 color = vec4(0.0); // The color of the pixel.
+
+  if (boxHit.x > 0) {
+    float dist = boxHit.y; // The distance to the bounding box.
+    float dist_max = boxHit.z; // The maximum distance to the bounding box.
+    vec3 box_inverse = 1.0 / box_max; // The inverse of the maximum boundary of the bounding box.
+
+    for (int i = 0; i < max_steps && dist < dist_max; ++i) {
+      vec3 ray_pos = ray_origin_l + ray_dir_l * dist; // The current position of the ray.
+      ray_pos *= box_inverse; // Ray position in the bounding box space.
+      float d = scene(ray_pos);
+      if (d < hitSurf) {
+        color = vec4(lighting(d, ray_pos, ray_dir_l), dist); // Shade the pixel, with the hit distance in alpha.
+        break;
+      }
+      float reach = d - distance(ray_origin_l + ray_dir_l * dist, ray_origin_r + ray_dir_r * dist) - hitSurf; // How far either side the right ray is empty.
+      if (reach > 0.0 && dist - reach <= clear) clear = max(clear, dist + reach);
+      dist += step_size; // Move the ray foward by step size.
+    }
+  }
+
+  right_start += floor((clear - right_start) / step_size) * step_size; // On the right eye's own steps.
+  return color;
+}
+
+void main() {
+  float right_start;
+  vec4 left = traceLeft(right_start); // March the left eye in full, exactly as the two pass render would.
+  vec4 right = trace(ray_origin_r, ray_dir_r, right_start); // March the right eye the same way, from where its ray may meet the scene.
+
+  frag_out0 = left; // Send the pixel colors out.
+  frag_out1 = right;
+}
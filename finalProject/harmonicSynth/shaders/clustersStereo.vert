@@ -0,0 +1,39 @@
+#version 330
+
+// Single pass stereo: generates the rays of both eyes, so one invocation of
+// clustersStereo.frag can trace the pair.
+
+// uniform mat4 al_ProjMatrix;
+uniform mat4 al_ModelMatrixInv;
+uniform mat4 al_ViewMatrixInv;
+uniform mat4 al_ProjMatrixInv;
+uniform float eye_half_sep; // Half of the eye separation, unsigned.
+uniform float foc_len;
+
+layout (location = 0) in vec3 position;
+
+out vec3 ray_dir_l, ray_origin_l; // The ray of the left eye.
+out vec3 ray_dir_r, ray_origin_r; // The ray of the right eye.
+
+void main()
+{
+  gl_Position = vec4(position.xy, -1., 1.);
+
+  mat4 ivp = al_ModelMatrixInv * al_ViewMatrixInv * al_ProjMatrixInv;
+  vec4 worldspace_near = ivp * vec4(position.xy, -1., 1.);
+  vec4 worldspace_far = worldspace_near + ivp[2];
+  worldspace_far /= worldspace_far.w;
+  worldspace_near /= worldspace_near.w;
+  vec3 ray_dir = normalize(worldspace_far.xyz - worldspace_near.xyz);
+  vec3 ray_origin = worldspace_near.xyz;
+
+  // stereo offset, the same as clusters.vert with eye_sep = -/+ eye_half_sep:
+  vec3 up = vec3(0, 1, 0);
+  vec3 rdx = cross(ray_dir, up);
+  vec3 eye_x = rdx * eye_half_sep;
+
+  ray_origin_l = ray_origin - eye_x;
+  ray_dir_l = normalize(ray_dir + eye_x / foc_len);
+  ray_origin_r = ray_origin + eye_x;
+  ray_dir_r = normalize(ray_dir - eye_x / foc_len);
+}
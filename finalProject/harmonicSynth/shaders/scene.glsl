@@ -0,0 +1,132 @@
+// Scene shared by the raymarch shaders, pulled in with #include "scene.glsl".
+
+// Variables rom the Application:
+uniform float time; // The time our application has been running.
+uniform vec3 cam_pos;
+uniform vec3 clusterPos;
+uniform float cluster_scale; // Size of the cluster, oscillating with the spectrum of its synthesizer.
+uniform sampler3D sdf_volume; // The cluster's distance field baked on the CPU.
+uniform int use_volume; // 1 to fetch distances from the baked volume instead of evaluating them.
+uniform vec3 volume_min, volume_max; // The region covered by the baked volume, relative to the cluster.
+
+// Internal Variables:
+float step_size = 0.01; // The distance each ray of light travels per step.
+float hitSurf = 0.01; // The distance from the ray to the object within we consider the ray to have hit.
+int max_steps = 1024; // The maximum amount of steps the ray can take before it's considered to have missed all surfaces.
+vec3 box_min = vec3(-1.0); // The minimum corner of the bounding box.
+vec3 box_max = vec3(1.0); // The maximum corner of the bounding box.
+
+
+// Check if the ray intersects the bounding box:
+vec3 rayBoxIntersect(const vec3 b_min, const vec3 b_max, const vec3 r_o, const vec3 r_d) {
+  vec3 inv_dir = 1.0 / r_d; // Inverse of the ray direction.
+  vec3 tbot = inv_dir * (b_min - r_o); // The distance to the minimum corner of the bounding box.
+  vec3 ttop = inv_dir * (b_max - r_o); // The distance to the maximum corner of the bounding box.
+  vec3 tmin = min(ttop, tbot); // The minimum distance to the bounding box.
+  vec3 tmax = max(ttop, tbot); // The maximum distance to the bounding box.
+
+  // What's going on here?
+  vec2 traverse = max(tmin.xx, tmin.yz);
+  float traverse_low = max(traverse.x, traverse.y);
+  traverse = min(tmax.xx, tmax.yz);
+  float traverse_high = min(traverse.x, traverse.y);
+
+  // Encode the different measurements of the boudning box to the ray in a vec3.
+  return vec3(float(traverse_high > max(traverse_low, 0.0)), traverse_low, traverse_high);
+}
+
+// Signed distance field formula for a sphere:
+float sphereSDF(vec3 center, float radius, vec3 toPoint){
+  return length(center - toPoint) - radius;
+}
+
+// Signed distance field formula for a box:
+// float boxSDF(vec3 center, vec3 size, vec3 toPoint) {
+//   vec3 d = abs(center - toPoint) - size;
+//   return min(max(d.x,max(d.y,d.z)),0.0) + length(max(d,0.0));
+// }
+
+// The SDF of our scene:
+float scene(vec3 p){
+  // The cluster is scaled uniformly, so its distances are evaluated at the unscaled size and scaled back:
+  vec3 local = (p - clusterPos) / cluster_scale; // Position relative to the unscaled cluster.
+  // Static shapes are baked, so one fetch replaces the whole evaluation below:
+  if (use_volume == 1) {
+    vec3 uvw = (local - volume_min) / (volume_max - volume_min); // Position inside the baked volume.
+    if (all(greaterThanEqual(uvw, vec3(0.0))) && all(lessThanEqual(uvw, vec3(1.0)))) { // If the point is inside the volume...
+      return texture(sdf_volume, uvw).r * cluster_scale; // Fetch the baked distance.
+    }
+  }
+  float d1 = sphereSDF(vec3(-0.5, 0.0, 0.0), 0.5, local); // Sphere one.
+  float d2 = sphereSDF(vec3(0.5, 0.0, 0.0), 0.1, local); // Sphere two.
+  float d3 = sphereSDF(vec3(0.0, 0.5, 0.0), 0.1, local); // Sphere three.
+  float d4 = sphereSDF(vec3(0.0, -0.5, 0.0), 0.2, local); // Sphere four.
+  float k = 8.0; // The smoothness coefficient of the minimum.
+  float res = exp2(-k * d1) + exp2(-k * d2) + exp2(-k * d3) + exp2(-k * d4); // Calculate the smooth minimum.
+  float smoothMin = -log2(res) / k; // Total distance. 
+  return smoothMin * cluster_scale;
+}
+
+// Get the normals of the objects in the scene:
+vec3 getNormals(float s, vec3 r_o, vec3 r_d) {
+    const float e = 0.01; // The epsilon value.
+    vec3 p = r_o + s * r_d; // The position of the ray.
+    // p -= noise.rgb;
+    float nx = scene(vec3(p.x + e, p.y, p.z)) - scene(vec3(p.x - e, p.y, p.z)); // The x component of the normal.
+    float ny = scene(vec3(p.x, p.y + e, p.z)) - scene(vec3(p.x, p.y - e, p.z)); // The y component of the normal.
+    float nz = scene(vec3(p.x, p.y, p.z + e)) - scene(vec3(p.x, p.y, p.z - e)); // The z component of the normal.
+    return normalize(vec3(nx, ny, nz)); // Return the normal.
+}
+
+// Lighting for the scene:
+vec3 lighting(float d, vec3 r_o, vec3 r_d){
+  float surface = d; // The distance to the surface.
+  vec3 rayOrigin = r_o; // The origin of the ray.
+  vec3 rayDir = r_d; // The direction of the ray.
+  vec3 lightPos = cam_pos; // The position of the light source, which will be the same as our camera nav.
+	vec3 n = getNormals(surface, rayOrigin, rayDir); // Get the normals of the objects.
+	vec3 l = normalize(lightPos); // The direction of the light source.
+	//vec3 rd = rayDir;
+	vec3 r = reflect(l, n); // The reflection of the light off of the normal.
+	vec3 kd = vec3(1.0, 1.0, 1.0); // The diffuse reflection coefficient, or the color of surface.
+	vec3 ks = vec3(0.5); // Specular reflection coefficient.
+	float s = 3.5; // Specular exponent, controlling the tightness of specular highlights.
+	float diff = max(dot(n, l), 0.05); // Diffuse reflection calculation.
+	float spec = pow(max(dot(r, rayDir), 0.5), s); // Specular reflection calculation.
+	return kd * diff + ks * spec; // Combine diffuse and specular reflection components using material coefficients.
+}
+
+// March a ray through the cluster's bounding box, starting no closer than start.
+// Returns the shaded color, with the hit distance in alpha (0 is a miss):
+vec4 trace(vec3 ro, vec3 rd, float start) {
+  vec3 slice_min = box_min; // The minimum corner of the bounding box.
+  vec3 slice_max = box_max; // The maximum corner of the bounding box.
+
+  slice_min = slice_min + clusterPos;
+  slice_max = slice_max + clusterPos;
+
+  vec3 boxHit = rayBoxIntersect(slice_min, slice_max, ro, rd); // Calculate whether the ray intersects the bounding box.
+
+  vec4 color = vec4(0.0); // The color of the pixel.
+
+  // If the ray intersects the bounding box:
+  if (boxHit.x > 0) {
+    float dist = max(boxHit.y, start); // The distance to the bounding box, or the seeded start.
+    float dist_max = boxHit.z; // The maximum distance to the bounding box.
+    vec3 box_inverse = 1.0 / box_max; // The inverse of the maximum boundary of the bounding box.
+
+    // Iterate steps to find the intersection of the ray with the scene:
+    for (int i = 0; i < max_steps && dist < dist_max; ++i) {
+      vec3 ray_pos = ro + rd * dist; // The current position of the ray.
+      ray_pos *= box_inverse; // Ray position in the bounding box space.
+      float d = scene(ray_pos); // Apply the position of the ray to the signed distance field function.
+      if (d < hitSurf) {
+        color = vec4(lighting(d, ray_pos, rd), dist); // Shade the pixel, and keep the hit distance in alpha for reprojection.
+        break;
+      }
+      dist += step_size; // Move the ray foward by step size.
+    }
+  }
+
+  return color;
+}
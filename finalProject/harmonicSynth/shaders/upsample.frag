@@ -0,0 +1,62 @@
+#version 330
+
+// Temporal upsampling of the scaled raymarch pass.
+// Shares the ray generation of the raymarch vertex shader.
+
+// Variables from the Application:
+uniform sampler2D tex_current; // The scaled raymarch image, hit distance in alpha.
+uniform sampler2D tex_history; // Last frame's resolved image, hit distance in alpha.
+uniform vec2 out_size; // The full output resolution.
+uniform vec2 low_size; // The scaled resolution.
+uniform vec2 sample_jitter; // The sub-pixel jitter the scaled image was rendered with.
+uniform float history_weight; // How much of the history to keep, 0 when there is none.
+uniform mat4 prev_view_proj; // Last frame's view projection matrix.
+uniform vec3 prev_cam_pos; // Last frame's camera position.
+
+// Internal Variables:
+float far_dist = 100.0; // Distance used to reproject rays that missed everything.
+float dist_tolerance = 0.05; // Relative difference in hit distance still considered the same surface.
+
+// Variables from the Vertex Shader:
+in vec3 ray_dir, ray_origin; // The direction and origin of the ray through this pixel.
+
+layout (location = 0) out vec4 frag_out0; // The resolved color, hit distance in alpha.
+
+void main() {
+  vec2 uv = gl_FragCoord.xy / out_size; // Position of the pixel on screen.
+  vec2 uv_cur = uv - sample_jitter * 0.5; // Undo this frame's jitter when reading the scaled image.
+  vec4 cur = texture(tex_current, uv_cur); // The current sample.
+
+  // Neighbourhood of the current sample, used to reject stale history:
+  vec3 lo = cur.rgb, hi = cur.rgb;
+  for (int x = -1; x <= 1; x++) {
+    for (int y = -1; y <= 1; y++) {
+      vec3 c = texture(tex_current, uv_cur + vec2(x, y) / low_size).rgb;
+      lo = min(lo, c);
+      hi = max(hi, c);
+    }
+  }
+
+  // Reproject the surface seen through this pixel into the previous frame:
+  float dist = cur.a > 0.0 ? cur.a : far_dist; // Misses reproject as far away background.
+  vec3 world = ray_origin + ray_dir * dist; // World position of the sample.
+  vec4 prev_clip = prev_view_proj * vec4(world, 1.0); // Position in last frame's clip space.
+  vec2 uv_prev = prev_clip.xy / prev_clip.w * 0.5 + 0.5; // Position on last frame's screen.
+
+  float w = history_weight;
+  if (prev_clip.w <= 0.0 || any(lessThan(uv_prev, vec2(0.0))) || any(greaterThan(uv_prev, vec2(1.0)))) {
+    w = 0.0; // The surface was off screen last frame.
+  }
+  vec4 hist = texture(tex_history, uv_prev);
+  if (cur.a > 0.0) { // If this pixel hit a surface...
+    float expected = distance(world, prev_cam_pos); // Distance the previous frame should have seen.
+    if (hist.a <= 0.0 || abs(hist.a - expected) > dist_tolerance * expected) {
+      w = 0.0; // Disocclusion, the history shows a different surface.
+    }
+  } else if (hist.a > 0.0) {
+    w = 0.0; // The history hit a surface that is gone now.
+  }
+
+  vec3 color = mix(cur.rgb, clamp(hist.rgb, lo, hi), w); // Blend with the clamped history.
+  frag_out0 = vec4(color, cur.a); // Keep the hit distance for the next frame.
+}
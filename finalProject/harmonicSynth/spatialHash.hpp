@@ -0,0 +1,129 @@
+// Spatial Hash:
+//
+// Finds every pair of points closer than a radius without checking all pairs.
+//
+// - Points are binned into cubic cells the size of the radius, and sorted by cell. A small open
+//   addressing table maps each occupied cell to its run of points.
+// - Each occupied cell only looks at the cells around it, each pair of cells once, so the cost
+//   follows the number of nearby points rather than the square of the point count.
+// - Everything is allocated in setup(), build() never allocates, so it can run on the audio thread.
+
+#pragma once
+
+#include <algorithm> // For std::sort, std::min, std::max.
+#include <cmath> // For std::floor.
+#include <cstdint> // For the cell keys.
+#include <vector> // For the cells and pairs.
+
+// Two points closer than the radius, a < b:
+struct PointPair {
+  int a, b;
+  float distance;
+};
+
+class SpatialHash {
+public:
+  // Allocate for a number of points and pairs:
+  void setup(int maxPoints, int maxPairs) {
+    mCells.reserve(maxPoints);
+    mPairs.reserve(maxPairs);
+    int size = 1;
+    while (size < 2 * maxPoints) size *= 2; // At most half full.
+    mTable.assign(size, Slot{});
+    mMaxPoints = maxPoints;
+    mMaxPairs = maxPairs;
+  }
+
+  // Find the pairs among count points, given as x, y, z triples. Pairs past maxPairs are dropped:
+  const std::vector<PointPair>& build(const float* xyz, int count, float radius) {
+    mCells.clear();
+    mPairs.clear();
+    if (radius <= 0.0f) return mPairs;
+    count = std::min(count, mMaxPoints);
+    float inverse = 1.0f / radius;
+    for (int i = 0; i < count; i++) { // Bin every point.
+      const float* p = xyz + 3 * i;
+      mCells.push_back({key(cell(p[0] * inverse), cell(p[1] * inverse), cell(p[2] * inverse)), i});
+    }
+    std::sort(mCells.begin(), mCells.end(), [](const Entry& l, const Entry& r) { return l.key < r.key; });
+    for (Slot& slot : mTable) slot.begin = slot.end = 0; // Empty the table.
+    for (int run = 0; run < int(mCells.size());) { // Index the run of each occupied cell.
+      int runEnd = run;
+      while (runEnd < int(mCells.size()) && mCells[runEnd].key == mCells[run].key) runEnd++;
+      size_t slot = slotOf(mCells[run].key);
+      while (mTable[slot].end != 0) slot = (slot + 1) & (mTable.size() - 1); // Probe for a free slot.
+      mTable[slot] = {mCells[run].key, run, runEnd};
+      run = runEnd;
+    }
+
+    float radius2 = radius * radius;
+    for (int run = 0; run < int(mCells.size());) { // For each occupied cell...
+      int runEnd = find(mCells[run].key).end;
+      const float* p0 = xyz + 3 * mCells[run].index;
+      int cx = cell(p0[0] * inverse), cy = cell(p0[1] * inverse), cz = cell(p0[2] * inverse);
+      for (int dz = -1; dz <= 1; dz++) { // Look in the neighbouring cells.
+        for (int dy = -1; dy <= 1; dy++) {
+          for (int dx = -1; dx <= 1; dx++) {
+            uint64_t k = key(cx + dx, cy + dy, cz + dz);
+            if (k < mCells[run].key) continue; // Each pair of cells once, from the lower key.
+            Slot found = find(k);
+            for (int i = run; i < runEnd; i++) {
+              const float* p = xyz + 3 * mCells[i].index;
+              int from = k == mCells[run].key ? i + 1 : found.begin; // Within a cell, each pair once.
+              for (int j = from; j < found.end; j++) {
+                const float* q = xyz + 3 * mCells[j].index;
+                float x = q[0] - p[0], y = q[1] - p[1], z = q[2] - p[2];
+                float d2 = x * x + y * y + z * z;
+                if (d2 < radius2 && int(mPairs.size()) < mMaxPairs) {
+                  mPairs.push_back({std::min(mCells[i].index, mCells[j].index), std::max(mCells[i].index, mCells[j].index), std::sqrt(d2)});
+                }
+              }
+            }
+          }
+        }
+      }
+      run = runEnd;
+    }
+    return mPairs;
+  }
+
+  const std::vector<PointPair>& pairs() const { return mPairs; }
+
+private:
+  struct Entry {
+    uint64_t key; // The cell.
+    int index; // The point.
+  };
+
+  // A cell's run of points in mCells, end is 0 for an empty slot:
+  struct Slot {
+    uint64_t key = 0;
+    int begin = 0, end = 0;
+  };
+
+  std::vector<Entry> mCells; // Points sorted by cell.
+  std::vector<Slot> mTable; // Occupied cells.
+  std::vector<PointPair> mPairs;
+  int mMaxPoints = 0, mMaxPairs = 0;
+
+  size_t slotOf(uint64_t key) const {
+    uint64_t h = key * 0x9E3779B97F4A7C15ull; // Mix the three axes into the low bits.
+    return size_t(h ^ (h >> 29) ^ (h >> 47)) & (mTable.size() - 1);
+  }
+
+  // The run of points in a cell, empty if the cell has none:
+  Slot find(uint64_t key) const {
+    for (size_t slot = slotOf(key);; slot = (slot + 1) & (mTable.size() - 1)) {
+      if (mTable[slot].end == 0) return Slot{}; // Not occupied.
+      if (mTable[slot].key == key) return mTable[slot];
+    }
+  }
+
+  static int cell(float x) { return int(std::floor(x)); }
+
+  // Pack a cell's coordinates into a key, 21 bits per axis, so different cells never share a key:
+  static uint64_t key(int x, int y, int z) {
+    const uint64_t mask = (1u << 21) - 1, bias = 1u << 20;
+    return ((uint64_t(x) + bias) & mask) | (((uint64_t(y) + bias) & mask) << 21) | (((uint64_t(z) + bias) & mask) << 42);
+  }
+};
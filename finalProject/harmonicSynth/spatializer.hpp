@@ -0,0 +1,166 @@
+// Spatializer:
+//
+// Pans each cluster's synthesizer to a speaker array from the cluster's position.
+//
+// - Panning is higher order ambisonics with a sampling decoder: a source is encoded into spherical
+//   harmonics up to a given order and decoded by sampling them in each speaker's direction. By the
+//   addition theorem the encode and decode matrices multiply out to a Legendre series in the angle
+//   between the source and the speaker, so the gain matrix is computed directly from that, with
+//   max rE weights for tighter images. This works for any layout, from stereo to the AlloSphere.
+// - Distance attenuates as 1 / distance beyond a reference distance.
+// - Gains are computed once per block per source, O(sources * speakers), and ramped linearly from
+//   the previous block's gains, so moving sources don't zipper.
+// - The block is mixed as one matrix multiply: each speaker is the sum of every source scaled by
+//   its ramped gain, in flat loops with no branching per sample.
+//
+// Directions are in the listener's frame, -z forward, x right, y up, as in allolib.
+// Everything is allocated in setup(), process() never allocates.
+
+#pragma once
+
+#include <algorithm> // For std::max, std::fill.
+#include <cmath> // For std::sqrt, std::cos, std::sin.
+#include <vector> // For the gains and speakers.
+
+// Unit directions of a set of speakers:
+struct SpeakerLayout {
+  std::vector<float> directions; // x, y, z triples.
+
+  int count() const { return int(directions.size() / 3); }
+
+  // Add a speaker at an azimuth (degrees clockwise from the front) and an elevation (degrees up):
+  void add(float azimuth, float elevation) {
+    float az = azimuth * float(M_PI) / 180.0f, el = elevation * float(M_PI) / 180.0f;
+    directions.push_back(std::cos(el) * std::sin(az)); // x, right.
+    directions.push_back(std::sin(el)); // y, up.
+    directions.push_back(-std::cos(el) * std::cos(az)); // z, forward is negative.
+  }
+
+  // Add a ring of evenly spaced speakers, the first one at the front:
+  void ring(int speakers, float elevation) {
+    for (int i = 0; i < speakers; i++) add(360.0f * i / speakers, elevation);
+  }
+
+  // A stereo pair at plus and minus 30 degrees:
+  static SpeakerLayout stereo() {
+    SpeakerLayout layout;
+    layout.add(-30.0f, 0.0f); // Left.
+    layout.add(30.0f, 0.0f); // Right.
+    return layout;
+  }
+
+  // The AlloSphere's three rings: 12 speakers above, 30 around the bridge and 12 below:
+  static SpeakerLayout allosphere() {
+    SpeakerLayout layout;
+    layout.ring(12, 41.0f);
+    layout.ring(30, 0.0f);
+    layout.ring(12, -32.5f);
+    return layout;
+  }
+
+  // A layout for a number of output channels, the AlloSphere when there are enough of them:
+  static SpeakerLayout forChannels(int channels) {
+    if (channels >= 54) return allosphere();
+    if (channels == 2) return stereo();
+    SpeakerLayout layout;
+    layout.ring(std::max(channels, 1), 0.0f); // Otherwise a horizontal ring.
+    return layout;
+  }
+};
+
+class Spatializer {
+public:
+  // Allocate every buffer, call before the audio thread starts:
+  void setup(const SpeakerLayout& layout, int maxSources, int order = 3, float referenceDistance = 1.0f) {
+    mLayout = layout;
+    mSpeakers = layout.count();
+    mSources = maxSources;
+    mReference = referenceDistance;
+    mGain.assign(size_t(maxSources) * mSpeakers, 0.0f);
+    mTarget.assign(size_t(maxSources) * mSpeakers, 0.0f);
+    mSet.assign(maxSources, 0);
+
+    // Weight of each order: (2l + 1) from the addition theorem, times the max rE taper:
+    mWeights.resize(order + 1);
+    double rE = std::cos(2.4068 / (order + 1.51)); // Approximation of the largest root of P_(order + 1).
+    for (int l = 0; l <= order; l++) mWeights[l] = float((2 * l + 1) * legendre(l, rE));
+  }
+
+  int speakers() const { return mSpeakers; }
+  const SpeakerLayout& layout() const { return mLayout; }
+
+  // Set where a source is for the next block, relative to the listener:
+  void position(int source, float x, float y, float z) {
+    float distance = std::sqrt(x * x + y * y + z * z);
+    float attenuation = mReference / std::max(distance, mReference); // 1 / distance beyond the reference.
+    float inverse = distance > 0.0f ? 1.0f / distance : 0.0f;
+    float* target = &mTarget[size_t(source) * mSpeakers];
+    float power = 0.0f;
+    for (int m = 0; m < mSpeakers; m++) { // Gain of each speaker from the angle between it and the source.
+      const float* d = &mLayout.directions[3 * m];
+      float cosine = distance > 0.0f ? (x * d[0] + y * d[1] + z * d[2]) * inverse : 0.0f; // A source at the listener plays everywhere.
+      target[m] = std::max(series(cosine), 0.0f) + 1e-4f; // Drop the negative lobes. The floor spreads a source no speaker faces over all of them.
+      power += target[m] * target[m];
+    }
+    float normalize = attenuation / std::sqrt(power); // Constant power wherever the source is.
+    for (int m = 0; m < mSpeakers; m++) target[m] *= normalize;
+    if (!mSet[source]) { // The first position is jumped to.
+      std::copy(target, target + mSpeakers, &mGain[size_t(source) * mSpeakers]);
+      mSet[source] = 1;
+    }
+  }
+
+  // Mix a block of every source into every speaker. out must have speakers() buffers, which are overwritten:
+  void process(const float* const* in, int sources, float* const* out, int frames) {
+    sources = std::min(sources, mSources);
+    float inverseFrames = 1.0f / frames;
+    for (int m = 0; m < mSpeakers; m++) std::fill(out[m], out[m] + frames, 0.0f);
+    for (int s = 0; s < sources; s++) {
+      float* gain = &mGain[size_t(s) * mSpeakers];
+      const float* target = &mTarget[size_t(s) * mSpeakers];
+      const float* source = in[s];
+      for (int m = 0; m < mSpeakers; m++) {
+        float g = gain[m], step = (target[m] - g) * inverseFrames; // Ramp from the last block's gain.
+        float* speaker = out[m];
+        for (int i = 0; i < frames; i++) speaker[i] += (g + step * (i + 1)) * source[i];
+        gain[m] = target[m];
+      }
+    }
+  }
+
+  // The gain of a source in a speaker, after the last block:
+  float gain(int source, int speaker) const { return mGain[size_t(source) * mSpeakers + speaker]; }
+
+private:
+  SpeakerLayout mLayout;
+  int mSpeakers = 0, mSources = 0;
+  float mReference = 1.0f;
+  std::vector<float> mGain, mTarget; // Source by speaker, at the end of the last block and the next.
+  std::vector<char> mSet; // Whether each source has a position yet.
+  std::vector<float> mWeights; // Weight of each order in the series.
+
+  // Legendre polynomial P_l(x), by the recurrence:
+  static double legendre(int l, double x) {
+    double p0 = 1.0, p1 = x;
+    if (l == 0) return p0;
+    for (int n = 2; n <= l; n++) {
+      double p2 = ((2 * n - 1) * x * p1 - (n - 1) * p0) / n;
+      p0 = p1;
+      p1 = p2;
+    }
+    return p1;
+  }
+
+  // Sum of the weighted Legendre series at the cosine of the angle between a source and a speaker:
+  float series(float x) const {
+    float p0 = 1.0f, p1 = x, sum = mWeights[0];
+    if (mWeights.size() > 1) sum += mWeights[1] * x;
+    for (int n = 2; n < int(mWeights.size()); n++) {
+      float p2 = ((2 * n - 1) * x * p1 - (n - 1) * p0) / n;
+      sum += mWeights[n] * p2;
+      p0 = p1;
+      p1 = p2;
+    }
+    return sum;
+  }
+};
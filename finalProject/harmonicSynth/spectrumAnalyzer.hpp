@@ -0,0 +1,274 @@
+// Spectrum Analyzer:
+//
+// Streaming FFT analysis of the synth's output, driving the oscillation of the metaball clusters.
+//
+// - The audio thread pushes each channel's block into a lock-free ring and returns, it never
+//   waits on the analysis.
+// - A worker thread drains the rings a hop at a time, windows the last fftSize samples with a
+//   Hann window (overlap of fftSize - hop) and runs a real FFT on them.
+// - The power spectrum is summed into a few log spaced bands per channel, and the band levels of
+//   every channel are published together through a TripleBuffer, so the render thread always
+//   reads a complete, recent frame.
+//
+// The real FFT packs the n real samples into n / 2 complex samples and runs a radix-2 complex FFT
+// of half the size on split real and imaginary arrays. The butterflies of each stage are a flat
+// loop over those arrays, which the compiler vectorizes.
+
+#pragma once
+
+#include "paramHandoff.hpp" // For publishing the band levels.
+#include "spscRing.hpp" // For the samples from the audio thread.
+#include <algorithm> // For std::copy, std::max.
+#include <atomic> // For the stop flag and the drop counter.
+#include <chrono> // For the worker's sleep and the benchmark.
+#include <cmath> // For std::cos, std::sin, std::sqrt, std::pow.
+#include <memory> // For the rings.
+#include <thread> // For the worker thread.
+#include <vector> // For the buffers.
+
+class RealFft {
+public:
+  // Precompute the tables for a power of two size:
+  void setup(int size) {
+    mSize = size;
+    mHalf = size / 2;
+    mRe.assign(mHalf + 1, 0.0f);
+    mIm.assign(mHalf + 1, 0.0f);
+    mTwiddleRe.resize(mHalf / 2 + 1); // Twiddles of the half size complex FFT.
+    mTwiddleIm.resize(mHalf / 2 + 1);
+    for (int k = 0; k <= mHalf / 2; k++) {
+      double angle = -2.0 * M_PI * k / mHalf;
+      mTwiddleRe[k] = float(std::cos(angle));
+      mTwiddleIm[k] = float(std::sin(angle));
+    }
+    mSplitRe.resize(mHalf + 1); // Twiddles that split the half size result into the real spectrum.
+    mSplitIm.resize(mHalf + 1);
+    for (int k = 0; k <= mHalf; k++) {
+      double angle = -2.0 * M_PI * k / mSize;
+      mSplitRe[k] = float(std::cos(angle));
+      mSplitIm[k] = float(std::sin(angle));
+    }
+    mReverse.resize(mHalf); // Bit reversed order of the half size.
+    int bits = 0;
+    while ((1 << bits) < mHalf) bits++;
+    for (int i = 0; i < mHalf; i++) {
+      int r = 0;
+      for (int b = 0; b < bits; b++) r |= ((i >> b) & 1) << (bits - 1 - b);
+      mReverse[i] = r;
+    }
+  }
+
+  int size() const { return mSize; }
+  int bins() const { return mHalf + 1; } // DC up to Nyquist.
+
+  // Transform size real samples, the bins are then in re() and im():
+  void forward(const float* in) {
+    for (int i = 0; i < mHalf; i++) { // Pack even samples as real, odd samples as imaginary, in bit reversed order.
+      int r = mReverse[i];
+      mRe[r] = in[2 * i];
+      mIm[r] = in[2 * i + 1];
+    }
+    complexFft();
+    split();
+  }
+
+  const float* re() const { return mRe.data(); }
+  const float* im() const { return mIm.data(); }
+
+private:
+  int mSize = 0, mHalf = 0;
+  std::vector<float> mRe, mIm; // Work buffers, then the spectrum.
+  std::vector<float> mTwiddleRe, mTwiddleIm, mSplitRe, mSplitIm;
+  std::vector<int> mReverse;
+
+  // In place radix-2 decimation in time, the input is already in bit reversed order:
+  void complexFft() {
+    float* re = mRe.data();
+    float* im = mIm.data();
+    for (int length = 2; length <= mHalf; length *= 2) { // For each stage...
+      int half = length / 2, stride = mHalf / length; // Twiddle stride of this stage.
+      for (int start = 0; start < mHalf; start += length) { // For each group of butterflies...
+        float* aRe = re + start;
+        float* aIm = im + start;
+        float* bRe = aRe + half;
+        float* bIm = aIm + half;
+        for (int j = 0; j < half; j++) { // For each butterfly, no dependency between iterations.
+          float wr = mTwiddleRe[j * stride], wi = mTwiddleIm[j * stride];
+          float tr = bRe[j] * wr - bIm[j] * wi;
+          float ti = bRe[j] * wi + bIm[j] * wr;
+          bRe[j] = aRe[j] - tr;
+          bIm[j] = aIm[j] - ti;
+          aRe[j] += tr;
+          aIm[j] += ti;
+        }
+      }
+    }
+  }
+
+  // Turn the half size complex spectrum into the bins of the real input:
+  void split() {
+    float* re = mRe.data();
+    float* im = mIm.data();
+    re[mHalf] = re[0]; // Z[n / 2] wraps around to Z[0].
+    im[mHalf] = im[0];
+    for (int k = 0; k <= mHalf / 2; k++) { // Bins k and n / 2 - k are computed together.
+      int m = mHalf - k;
+      float evenRe = 0.5f * (re[k] + re[m]), evenIm = 0.5f * (im[k] - im[m]); // Spectrum of the even samples.
+      float oddRe = 0.5f * (im[k] + im[m]), oddIm = -0.5f * (re[k] - re[m]); // Spectrum of the odd samples.
+      re[k] = evenRe + mSplitRe[k] * oddRe - mSplitIm[k] * oddIm;
+      im[k] = evenIm + mSplitRe[k] * oddIm + mSplitIm[k] * oddRe;
+      re[m] = evenRe + mSplitRe[m] * oddRe + mSplitIm[m] * oddIm; // Bin m sees the conjugates of both.
+      im[m] = -evenIm - mSplitRe[m] * oddIm + mSplitIm[m] * oddRe;
+    }
+  }
+};
+
+// Band levels of every channel, as published to the render thread:
+template <int Channels, int Bands>
+struct SpectrumFrame {
+  float level[Channels][Bands]; // Amplitude of the signal in each band, a sine of amplitude 1 reads as 1.
+  unsigned hop; // Number of hops analyzed so far.
+};
+
+template <int Channels, int Bands = 8>
+class SpectrumAnalyzer {
+public:
+  using Frame = SpectrumFrame<Channels, Bands>;
+
+  ~SpectrumAnalyzer() { stop(); }
+
+  // Allocate every buffer, call before the audio thread starts. The FFT size must be a power of two:
+  void setup(double sampleRate, int fftSize = 1024, int hop = 256, float lowestHz = 40.0f) {
+    mFftSize = fftSize;
+    mHop = hop;
+    mFft.setup(fftSize);
+    mRings.reset(new Ring[Channels]);
+    mHistory.assign(size_t(Channels) * fftSize, 0.0f);
+    mWindowed.assign(fftSize, 0.0f);
+    mHopBuffer.assign(hop, 0.0f);
+    mWindow.resize(fftSize);
+    double windowPower = 0.0;
+    for (int i = 0; i < fftSize; i++) {
+      mWindow[i] = float(0.5 - 0.5 * std::cos(2.0 * M_PI * i / fftSize)); // Hann window.
+      windowPower += double(mWindow[i]) * mWindow[i];
+    }
+    mScale = float(std::sqrt(4.0 / (fftSize * windowPower))); // By Parseval, a sine of amplitude 1 inside a band reads as 1.
+
+    // Log spaced band edges from lowestHz up to Nyquist, in bins:
+    double nyquist = sampleRate / 2.0, binHz = sampleRate / fftSize;
+    for (int b = 0; b <= Bands; b++) {
+      double hz = lowestHz * std::pow(nyquist / lowestHz, double(b) / Bands);
+      mEdges[b] = std::max(1, std::min(mFft.bins(), int(hz / binHz + 0.5)));
+    }
+    mEdges[Bands] = mFft.bins();
+    mFrame = Frame{};
+  }
+
+  // Queue a block of samples of one channel. Audio thread only, never blocks:
+  void push(int channel, const float* samples, int frames) {
+    size_t pushed = mRings[channel].push(samples, size_t(frames));
+    if (pushed < size_t(frames)) mDropped += unsigned(frames - pushed); // The worker has fallen behind.
+  }
+
+  // Start and stop analyzing on the worker thread:
+  void start() {
+    if (mThread.joinable()) return; // Already running.
+    mRunning = true;
+    mThread = std::thread([this]() {
+      while (mRunning) {
+        if (!process()) std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Wait for the next hop.
+      }
+    });
+  }
+
+  void stop() {
+    mRunning = false;
+    if (mThread.joinable()) mThread.join();
+  }
+
+  // Analyze every complete hop waiting in the rings and publish the result, returns false if there was none.
+  // Called by the worker thread, or directly when there is no worker:
+  bool process() {
+    bool analyzed = false;
+    while (ready()) { // Channels are pushed in lockstep, so a hop is ready when every channel has one.
+      for (int c = 0; c < Channels; c++) analyze(c);
+      mFrame.hop++;
+      analyzed = true;
+    }
+    if (analyzed) mLevels.write(mFrame); // Publish only the latest hop.
+    return analyzed;
+  }
+
+  // Take the latest published levels, returns false if there are none newer. Render thread only:
+  bool update() { return mLevels.update(); }
+  const Frame& levels() const { return mLevels.front(); }
+
+  // Center frequency of a band:
+  float bandHz(int band, double sampleRate) const {
+    return float(std::sqrt(double(mEdges[band]) * mEdges[band + 1]) * sampleRate / mFftSize);
+  }
+
+  unsigned dropped() const { return mDropped; }
+
+private:
+  using Ring = SpscRing<float, 16384>; // About a third of a second per channel at 44.1 kHz.
+
+  int mFftSize = 0, mHop = 0;
+  RealFft mFft;
+  std::unique_ptr<Ring[]> mRings; // One per channel.
+  std::vector<float> mHistory; // The last fftSize samples of each channel.
+  std::vector<float> mWindow, mWindowed, mHopBuffer;
+  float mScale = 1.0f;
+  int mEdges[Bands + 1] = {}; // First bin of each band, and the end of the last.
+  Frame mFrame{}; // The levels being analyzed, worker thread only.
+  TripleBuffer<Frame> mLevels; // The levels published to the render thread.
+  std::thread mThread;
+  std::atomic<bool> mRunning{false};
+  std::atomic<unsigned> mDropped{0};
+
+  bool ready() const {
+    for (int c = 0; c < Channels; c++) {
+      if (mRings[c].size() < size_t(mHop)) return false;
+    }
+    return true;
+  }
+
+  // Slide one channel's history by a hop and measure its bands:
+  void analyze(int channel) {
+    float* history = &mHistory[size_t(channel) * mFftSize];
+    mRings[channel].pop(mHopBuffer.data(), size_t(mHop));
+    std::copy(history + mHop, history + mFftSize, history); // Slide by a hop.
+    std::copy(mHopBuffer.begin(), mHopBuffer.end(), history + mFftSize - mHop);
+    for (int i = 0; i < mFftSize; i++) mWindowed[i] = history[i] * mWindow[i];
+    mFft.forward(mWindowed.data());
+
+    const float* re = mFft.re();
+    const float* im = mFft.im();
+    for (int b = 0; b < Bands; b++) {
+      float power = 0.0f;
+      for (int k = mEdges[b]; k < mEdges[b + 1]; k++) power += re[k] * re[k] + im[k] * im[k];
+      mFrame.level[channel][b] = mScale * std::sqrt(power);
+    }
+  }
+};
+
+// Push and analyze a number of seconds of noise, returns how many times faster than real time it ran:
+template <int Channels>
+double benchmarkSpectrumAnalyzer(double seconds = 10.0, int blockSize = 512, double sampleRate = 44100.0) {
+  SpectrumAnalyzer<Channels> analyzer;
+  analyzer.setup(sampleRate);
+  std::vector<float> block(blockSize);
+  unsigned seed = 1;
+  for (float& s : block) { // Noise, so every band has something in it.
+    seed = seed * 1664525u + 1013904223u;
+    s = float(seed >> 8) / float(1 << 24) * 2.0f - 1.0f;
+  }
+  int blocks = int(seconds * sampleRate / blockSize);
+  auto start = std::chrono::steady_clock::now();
+  for (int b = 0; b < blocks; b++) {
+    for (int c = 0; c < Channels; c++) analyzer.push(c, block.data(), blockSize);
+    analyzer.process();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return seconds / elapsed;
+}
@@ -0,0 +1,66 @@
+// SPSC Ring:
+//
+// A fixed size, lock-free ring buffer for one producer thread and one consumer thread.
+// Neither side ever blocks or allocates, so it is safe to use from the animation and audio threads.
+// The capacity must be a power of two.
+
+#pragma once
+
+#include <atomic> // For the read and write positions.
+#include <cstddef> // For size_t.
+
+template <class T, size_t Capacity>
+class SpscRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+  // Push one item, returns false when the ring is full. Producer thread only:
+  bool push(const T& item) {
+    size_t write = mWrite.load(std::memory_order_relaxed);
+    if (write - mRead.load(std::memory_order_acquire) == Capacity) return false; // Full.
+    mItems[write & (Capacity - 1)] = item;
+    mWrite.store(write + 1, std::memory_order_release); // Publish the item.
+    return true;
+  }
+
+  // Push as many items as fit, returns how many were pushed. Producer thread only:
+  size_t push(const T* items, size_t count) {
+    size_t write = mWrite.load(std::memory_order_relaxed);
+    size_t space = Capacity - (write - mRead.load(std::memory_order_acquire));
+    if (count > space) count = space;
+    for (size_t i = 0; i < count; i++) mItems[(write + i) & (Capacity - 1)] = items[i];
+    mWrite.store(write + count, std::memory_order_release); // Publish the items.
+    return count;
+  }
+
+  // Pop one item, returns false when the ring is empty. Consumer thread only:
+  bool pop(T& item) {
+    size_t read = mRead.load(std::memory_order_relaxed);
+    if (read == mWrite.load(std::memory_order_acquire)) return false; // Empty.
+    item = mItems[read & (Capacity - 1)];
+    mRead.store(read + 1, std::memory_order_release); // Free the slot.
+    return true;
+  }
+
+  // Pop up to count items, returns how many were popped. Consumer thread only:
+  size_t pop(T* items, size_t count) {
+    size_t read = mRead.load(std::memory_order_relaxed);
+    size_t available = mWrite.load(std::memory_order_acquire) - read;
+    if (count > available) count = available;
+    for (size_t i = 0; i < count; i++) items[i] = mItems[(read + i) & (Capacity - 1)];
+    mRead.store(read + count, std::memory_order_release); // Free the slots.
+    return count;
+  }
+
+  // Number of items waiting, approximate when called while the other side is active:
+  size_t size() const {
+    return mWrite.load(std::memory_order_acquire) - mRead.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+private:
+  T mItems[Capacity];
+  alignas(64) std::atomic<size_t> mWrite{0}; // Next slot to write, only advanced by the producer.
+  alignas(64) std::atomic<size_t> mRead{0}; // Next slot to read, only advanced by the consumer.
+};
@@ -0,0 +1,162 @@
+// Stereo Tracer:
+//
+// CPU reference of the raymarch in scene.glsl, used to check that the single pass stereo shader
+// (clustersStereo.frag) sees the same surfaces as rendering each eye in its own pass.
+// While the left eye marches, each of its samples bounds the scene distance along the right eye's
+// ray nearby, so the right eye starts after the stretch of its ray those bounds prove empty.
+// The right eye then marches with the same fixed steps, on the same positions, as its own pass, so
+// the two agree wherever the bound holds, including surfaces only the right eye sees.
+
+#pragma once
+
+#include "al/math/al_Vec.hpp" // Vectors.
+#include <algorithm> // For std::min, std::max.
+#include <cmath> // For std::tan, std::abs, std::floor, std::sqrt.
+
+// Settings matching the internal variables of scene.glsl:
+struct TraceSettings {
+  float stepSize = 0.01f; // The distance each ray travels per step.
+  float hitSurf = 0.01f; // The distance within which the ray has hit.
+  int maxSteps = 1024; // The maximum amount of steps.
+  al::Vec3f boxMin = al::Vec3f(-1.0f); // The bounding box, relative to the cluster.
+  al::Vec3f boxMax = al::Vec3f(1.0f);
+};
+
+// Hit distance along the ray (0 is a miss) and the number of scene evaluations it took:
+struct TraceResult {
+  float dist = 0.0f;
+  int steps = 0;
+};
+
+// Port of rayBoxIntersect(), returns false when the ray misses the box:
+inline bool rayBoxIntersect(al::Vec3f bMin, al::Vec3f bMax, al::Vec3f ro, al::Vec3f rd, float& low, float& high) {
+  low = -1e30f;
+  high = 1e30f;
+  for (int a = 0; a < 3; a++) {
+    float inv = 1.0f / rd[a];
+    float t0 = inv * (bMin[a] - ro[a]), t1 = inv * (bMax[a] - ro[a]);
+    low = std::max(low, std::min(t0, t1));
+    high = std::min(high, std::max(t0, t1));
+  }
+  return high > std::max(low, 0.0f);
+}
+
+// Port of trace(), the scene is a callable taking a world position:
+template <class Scene>
+TraceResult traceRay(const Scene& scene, al::Vec3f clusterPos, al::Vec3f ro, al::Vec3f rd, float start, const TraceSettings& s) {
+  TraceResult result;
+  float low, high;
+  if (!rayBoxIntersect(s.boxMin + clusterPos, s.boxMax + clusterPos, ro, rd, low, high)) return result; // Missed the box.
+  float dist = std::max(low, start); // The start of the box, or the seed.
+  for (int i = 0; i < s.maxSteps && dist < high; i++) {
+    result.steps++;
+    float d = scene(ro + rd * dist);
+    if (d < s.hitSurf) { // If the ray has hit...
+      result.dist = dist;
+      return result;
+    }
+    dist += s.stepSize; // Move the ray forward.
+  }
+  return result;
+}
+
+// Port of traceLeft() in clustersStereo.frag: the left eye's march, the same as traceRay(), which
+// also returns in rightStart where the right eye's march can begin. A left sample at distance t, a
+// distance d from the scene, keeps the right ray's point at t' at least d - |t' - t| - separation(t)
+// away, so the right ray is empty within d - separation(t) - hitSurf of t. The right eye starts at
+// the last of its own steps before the first gap in those intervals:
+template <class Scene>
+TraceResult traceLeft(const Scene& scene, al::Vec3f clusterPos, al::Vec3f roL, al::Vec3f rdL, al::Vec3f roR, al::Vec3f rdR, const TraceSettings& s, float& rightStart) {
+  TraceResult result;
+  float lowR, highR;
+  rayBoxIntersect(s.boxMin + clusterPos, s.boxMax + clusterPos, roR, rdR, lowR, highR);
+  rightStart = std::max(lowR, 0.0f); // Where the right eye's own pass starts...
+  float clear = rightStart; // ...and how far its ray is proven empty.
+  float low, high;
+  if (!rayBoxIntersect(s.boxMin + clusterPos, s.boxMax + clusterPos, roL, rdL, low, high)) return result; // Missed the box.
+  float dist = std::max(low, 0.0f);
+  for (int i = 0; i < s.maxSteps && dist < high; i++) {
+    result.steps++;
+    float d = scene(roL + rdL * dist);
+    if (d < s.hitSurf) { // If the ray has hit...
+      result.dist = dist;
+      break;
+    }
+    float reach = d - ((roL + rdL * dist) - (roR + rdR * dist)).mag() - s.hitSurf; // How far either side the right ray is empty.
+    if (reach > 0.0f && dist - reach <= clear) clear = std::max(clear, dist + reach);
+    dist += s.stepSize;
+  }
+  rightStart += std::floor((clear - rightStart) / s.stepSize) * s.stepSize; // On the right eye's own steps.
+  return result;
+}
+
+struct StereoCheck {
+  int pixels = 0; // Pixels compared.
+  int mismatches = 0; // Pixels where the single pass right eye disagrees with the two pass right eye.
+  int rightOnly = 0; // Pixels where the right eye hits more than twice the rays' separation in front of the left eye's hit.
+  float maxDistError = 0.0f; // Largest difference in hit distance among matching hits.
+  long stepsTwoPass = 0; // Scene evaluations for both eyes rendered separately.
+  long stepsSinglePass = 0; // Scene evaluations for the single pass.
+};
+
+// Trace a grid of pixels for a camera at camPos, facing forward with right and up its other axes,
+// the same way the shaders do:
+template <class Scene>
+StereoCheck verifyStereo(const Scene& scene, al::Vec3f clusterPos, al::Vec3f camPos, al::Vec3f right, al::Vec3f up, al::Vec3f forward, float fovy, float aspect, float eyeSep, float focLen, int width, int height, const TraceSettings& s = TraceSettings()) {
+  StereoCheck check;
+  float tanHalf = std::tan(fovy * 0.5f * 3.14159265f / 180.0f);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      // Ray through the pixel center, as in clusters.vert:
+      float nx = (x + 0.5f) / width * 2.0f - 1.0f, ny = (y + 0.5f) / height * 2.0f - 1.0f;
+      al::Vec3f rd = (forward + right * (nx * tanHalf * aspect) + up * (ny * tanHalf)).normalize();
+      al::Vec3f eyeX = cross(rd, al::Vec3f(0, 1, 0)) * (eyeSep * 0.5f); // The stereo offset.
+      al::Vec3f roL = camPos - eyeX, rdL = (rd + eyeX / focLen).normalize();
+      al::Vec3f roR = camPos + eyeX, rdR = (rd - eyeX / focLen).normalize();
+
+      TraceResult left = traceRay(scene, clusterPos, roL, rdL, 0.0f, s);
+      TraceResult right = traceRay(scene, clusterPos, roR, rdR, 0.0f, s); // Two pass right eye.
+      float start;
+      TraceResult leftSingle = traceLeft(scene, clusterPos, roL, rdL, roR, rdR, s, start);
+      TraceResult seeded = traceRay(scene, clusterPos, roR, rdR, start, s); // Single pass right eye.
+
+      check.pixels++;
+      check.stepsTwoPass += left.steps + right.steps;
+      check.stepsSinglePass += leftSingle.steps + seeded.steps;
+      float separation = left.dist > 0.0f ? ((roL + rdL * left.dist) - (roR + rdR * left.dist)).mag() : 0.0f;
+      check.rightOnly += right.dist > 0.0f && left.dist > 0.0f && right.dist < left.dist - 2.0f * separation - 2.0f * s.stepSize;
+      bool hitTwo = right.dist > 0.0f, hitSingle = seeded.dist > 0.0f;
+      float error = std::abs(right.dist - seeded.dist);
+      if (leftSingle.dist != left.dist || hitTwo != hitSingle || error > s.stepSize) { // A different surface, or missed it entirely.
+        check.mismatches++;
+      } else {
+        check.maxDistError = std::max(check.maxDistError, error);
+      }
+    }
+  }
+  return check;
+}
+
+// Check the single pass on a scene made to catch it out, a thin post in front of a wall, close
+// enough that through many pixels the right eye sees the post where the left eye sees the wall.
+// The camera looks down -z from the origin, then again turned to face -x from elsewhere.
+// Returns whether the single pass matched two passes on every pixel of both:
+inline bool checkStereoOcclusion(StereoCheck& front, StereoCheck& turned) {
+  TraceSettings settings;
+  settings.boxMin = al::Vec3f(-2.0f);
+  settings.boxMax = al::Vec3f(2.0f);
+  auto check = [&](al::Vec3f camPos, al::Vec3f right, al::Vec3f forward) {
+    al::Vec3f up(0, 1, 0);
+    auto scene = [&](const al::Vec3f& p) { // The post and the wall, placed in front of the camera.
+      al::Vec3f q = p - camPos;
+      float x = q.dot(right), z = q.dot(forward);
+      float post = std::sqrt((x - 0.05f) * (x - 0.05f) + (z - 1.0f) * (z - 1.0f)) - 0.02f; // Upright, 1 ahead.
+      float wall = 3.0f - z; // 3 ahead.
+      return std::min(post, wall);
+    };
+    return verifyStereo(scene, camPos + forward * 2.0f, camPos, right, up, forward, 60.0f, 1.5f, 0.2f, 6.0f, 120, 80, settings);
+  };
+  front = check(al::Vec3f(0, 0, 0), al::Vec3f(1, 0, 0), al::Vec3f(0, 0, -1));
+  turned = check(al::Vec3f(2.0f, 0.5f, 1.0f), al::Vec3f(0, 0, -1), al::Vec3f(-1, 0, 0));
+  return front.mismatches == 0 && turned.mismatches == 0 && front.rightOnly > 0 && turned.rightOnly > 0;
+}
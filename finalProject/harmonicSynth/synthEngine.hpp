@@ -0,0 +1,173 @@
+// Synth Engine:
+//
+// The whole audio graph of the piece, independent of the audio device, so the same code runs in
+// the audio callback and in offline renders.
+//
+// - The animation thread fills params.back() once per frame and publishes it.
+// - process() renders a block: it takes the latest snapshot, smooths it, builds the FM matrix,
+//   renders the oscillators, queues each cluster for the spectrum analysis, adds the distance
+//   cues, pans every cluster to the speakers and adds the shared late reverb.
+// - The spectrum analysis runs on a worker thread in real time. Offline, analyze() runs it in
+//   line after each block instead, so renders are deterministic.
+
+#pragma once
+
+#include "oscillatorBank.hpp" // Block based sine oscillators.
+#include "paramHandoff.hpp" // Lock-free parameter snapshots.
+#include "spectrumAnalyzer.hpp" // FFT analysis of each cluster's synthesizer.
+#include "fmMatrix.hpp" // Frequency modulation between nearby clusters.
+#include "spatializer.hpp" // Pans the clusters to the speakers.
+#include "reverb.hpp" // Distance filtering, early reflections and the shared late reverb.
+#include <algorithm> // For std::fill, std::min.
+#include <cmath> // For std::sqrt.
+#include <vector> // For the block buffers.
+
+// Synthesizer Layout:
+const int numClusters = 1; // Number of metaball clusters, each with its own oscillators.
+const int numPartials = 8; // Overtone tuned sine oscillators per cluster.
+const int numBands = 8; // Spectrum bands analyzed per cluster.
+
+// Synth parameters of a cluster, computed on the animation thread and read on the audio thread:
+struct ClusterParams {
+  float position[3]; // Position of the cluster.
+  float relative[3]; // Position relative to the listener, in the listener's frame.
+  float fundamental; // Fundamental frequency of the cluster's oscillators.
+  float glissando; // Glissando rate in octaves per second.
+  float fmAmount; // Amount of frequency modulation applied.
+};
+
+// Everything the audio thread needs from one animation frame:
+struct SynthSnapshot {
+  ClusterParams clusters[numClusters];
+  float volume; // Output level.
+  float fmDistance; // Clusters closer than this modulate each other.
+  float reverbSend; // How much of a distant cluster is sent to the late reverb.
+  float reverbTime; // Time for the late reverb to decay by 60 dB.
+};
+
+// Layout of the smoothed values on the audio thread:
+const int smoothedPerCluster = 7; // Position x, y, z, FM amount, and relative position x, y, z.
+const int smoothedVolume = numClusters * smoothedPerCluster; // The output level comes after the clusters.
+
+class SynthEngine {
+public:
+  TripleBuffer<SynthSnapshot> params; // Hands parameter snapshots from the animation thread to the audio thread.
+  SpectrumAnalyzer<numClusters, numBands> spectrum; // Analyzes each cluster's synthesizer, read by the animation thread.
+
+  ~SynthEngine() { stop(); }
+
+  // Allocate every buffer, call before audio starts. The speakers are chosen from the number of outputs.
+  // With analysisThread off, call analyze() after each block:
+  void setup(int blockSize, double sampleRate, int outputs, bool analysisThread = true) {
+    mBlockSize = blockSize;
+    oscillators.setup(numClusters * numPartials, blockSize, sampleRate); // The sine oscillators of every cluster, voice = cluster * numPartials + partial.
+    smoother.setup(smoothedVolume + 1, sampleRate);
+    volumeCurve.resize(blockSize);
+    clusterMix.resize(numClusters * blockSize);
+    fm.setup(numClusters, blockSize, sampleRate);
+    spatializer.setup(SpeakerLayout::forChannels(outputs), numClusters); // Stereo, or the AlloSphere's speakers.
+    sourceBlocks.resize(numClusters);
+    clusterBlocks.resize(numClusters);
+    distanceFilters.setup(numClusters, blockSize, sampleRate);
+    reflections.setup(numClusters, sampleRate);
+    lateReverb.setup(sampleRate);
+    reverbIn.resize(blockSize);
+    spectrum.setup(sampleRate);
+    if (analysisThread) spectrum.start(); // Analyze on the worker thread.
+  }
+
+  // Stop the analysis thread:
+  void stop() { spectrum.stop(); }
+
+  // Run the spectrum analysis on the calling thread, when there is no worker:
+  void analyze() { spectrum.process(); }
+
+  int speakers() const { return spatializer.speakers(); }
+  int blockSize() const { return mBlockSize; }
+
+  // Render a block into speakers() output buffers, which are overwritten. Never blocks or allocates:
+  void process(float* const* out, int frames) {
+    frames = std::min(frames, mBlockSize);
+
+    // Take the latest snapshot from the animation thread, if there is a new one:
+    if (params.update()) {
+      const SynthSnapshot& snapshot = params.front();
+      for (int c = 0; c < numClusters; c++) { // For each cluster...
+        const ClusterParams& cluster = snapshot.clusters[c];
+        for (int a = 0; a < 3; a++) smoother.target(c * smoothedPerCluster + a, cluster.position[a]); // Smooth the position.
+        smoother.target(c * smoothedPerCluster + 3, cluster.fmAmount); // Smooth the FM amount.
+        for (int a = 0; a < 3; a++) smoother.target(c * smoothedPerCluster + 4 + a, cluster.relative[a]); // Smooth the position heard.
+        fm.frequency(c, cluster.fundamental); // Nearby clusters are modulated at this cluster's fundamental.
+        for (int n = 0; n < numPartials; n++) { // For each overtone...
+          int voice = c * numPartials + n;
+          oscillators.frequency(voice, cluster.fundamental * (n + 1)); // Tune to the overtone series of the fundamental.
+          oscillators.amplitude(voice, 1.0f / (n + 1)); // Higher overtones are quieter.
+          oscillators.glide(voice, cluster.glissando); // Glide to new fundamentals.
+        }
+      }
+      smoother.target(smoothedVolume, snapshot.volume); // Smooth the output level.
+      lateReverb.decay(snapshot.reverbTime); // Set the decay time, no allocation.
+    }
+    const SynthSnapshot& snapshot = params.front();
+    for (int i = 0; i < smoothedVolume; i++) smoother.advance(i, frames); // Advance the smoothed cluster values by a block.
+
+    // Clusters close to each other modulate one another:
+    for (int c = 0; c < numClusters; c++) {
+      for (int a = 0; a < 3; a++) fmPositions[c * 3 + a] = smoother.value(c * smoothedPerCluster + a);
+      fmAmounts[c] = smoother.value(c * smoothedPerCluster + 3);
+    }
+    fm.build(fmPositions, fmAmounts, numClusters, snapshot.fmDistance); // Find the pairs, once per block.
+    fm.render(frames); // Render the modulation of each cluster.
+    for (int c = 0; c < numClusters; c++) {
+      for (int n = 0; n < numPartials; n++) oscillators.modulation(c * numPartials + n, fm.modulation(c)); // Modulate every overtone of the cluster.
+    }
+    oscillators.render(frames); // Render the block.
+
+    smoother.process(smoothedVolume, volumeCurve.data(), frames); // The output level, sample by sample.
+    for (int c = 0; c < numClusters; c++) { // For each cluster...
+      float* mix = &clusterMix[c * frames];
+      std::fill(mix, mix + frames, 0.0f);
+      for (int n = 0; n < numPartials; n++) { // Mix its overtones.
+        const float* voice = oscillators.output(c * numPartials + n);
+        for (int i = 0; i < frames; i++) mix[i] += voice[i] / numPartials;
+      }
+      spectrum.push(c, mix, frames); // Queue it for the analysis, without waiting.
+      for (int i = 0; i < frames; i++) mix[i] *= volumeCurve[i]; // Apply the output level.
+      int r = c * smoothedPerCluster + 4;
+      float x = smoother.value(r), y = smoother.value(r + 1), z = smoother.value(r + 2);
+      spatializer.position(c, x, y, z); // Where the cluster is heard from.
+      float distance = std::sqrt(x * x + y * y + z * z);
+      distanceFilters.lowpass(0, c, 20000.0f / (1.0f + 0.2f * distance)); // Farther clusters lose their highs to the air.
+      distanceFilters.highShelf(1, c, 3000.0f, -std::min(1.5f * distance, 18.0f)); // And their presence.
+      reverbSends[c] = snapshot.reverbSend * distance / (distance + 2.0f); // Farther clusters are more reverberant.
+      sourceBlocks[c] = clusterBlocks[c] = mix;
+    }
+
+    // Distance cues for each cluster, feeding the shared late reverb:
+    distanceFilters.process(clusterBlocks.data(), numClusters, frames);
+    std::fill(reverbIn.begin(), reverbIn.begin() + frames, 0.0f);
+    reflections.process(clusterBlocks.data(), numClusters, frames, reverbSends, reverbIn.data());
+
+    // Pan every cluster to the speakers in one pass, then add the late reverb to all of them:
+    spatializer.process(sourceBlocks.data(), numClusters, out, frames);
+    lateReverb.process(reverbIn.data(), out, spatializer.speakers(), frames);
+  }
+
+private:
+  int mBlockSize = 0;
+  OscillatorBank oscillators; // The sine oscillators of every cluster.
+  ParamSmoother smoother; // Smooths the snapshot values on the audio thread.
+  std::vector<float> volumeCurve; // The smoothed output level of a block, sample by sample.
+  std::vector<float> clusterMix; // One block of each cluster's synthesizer.
+  FmMatrix fm; // Modulation between nearby clusters, rebuilt every block.
+  float fmPositions[numClusters * 3]; // Smoothed cluster positions for the FM pair search.
+  float fmAmounts[numClusters]; // Smoothed FM amount of each cluster.
+  Spatializer spatializer; // Pans each cluster to the speakers from its position.
+  std::vector<const float*> sourceBlocks; // Each cluster's block, as the spatializer's sources.
+  std::vector<float*> clusterBlocks; // Each cluster's block, filtered in place.
+  VoiceFilters distanceFilters; // Air absorption for each cluster.
+  EarlyReflections reflections; // Early reflections for each cluster.
+  FdnReverb lateReverb; // One late reverb shared by every cluster.
+  std::vector<float> reverbIn; // The sum of every cluster's send.
+  float reverbSends[numClusters]; // Send level of each cluster.
+};
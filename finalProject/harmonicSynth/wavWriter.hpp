@@ -0,0 +1,97 @@
+// WAV Writer:
+//
+// Writes multichannel 32 bit float WAV files, for offline renders of the synthesizer.
+// Blocks are given one buffer per channel and interleaved on the way out. The sizes in the
+// header are filled in when the file is closed.
+// A plain WAV's sizes are 32 bit, so a long multichannel render (54 channels pass 4 GB in
+// about 7.5 minutes) is closed as RF64 instead: the JUNK chunk reserved at the start becomes a
+// ds64 chunk holding the 64 bit sizes. More than 2 channels use WAVE_FORMAT_EXTENSIBLE, which
+// readers expect for that many.
+
+#pragma once
+
+#include <cstdint> // For the header fields.
+#include <cstdio> // For the file.
+#include <string> // For the path.
+#include <vector> // For interleaving.
+
+class WavWriter {
+public:
+  ~WavWriter() { close(); }
+
+  bool open(const std::string& path, int channels, int sampleRate) {
+    close();
+    mFile = fopen(path.c_str(), "wb");
+    if (!mFile) return false;
+    mChannels = channels;
+    mSampleRate = sampleRate;
+    mFrames = 0;
+    writeHeader(); // Sizes are patched in close().
+    return true;
+  }
+
+  // Write a block, one buffer per channel:
+  void write(const float* const* channels, int frames) {
+    if (!mFile) return;
+    mInterleaved.resize(size_t(frames) * mChannels);
+    for (int c = 0; c < mChannels; c++) {
+      for (int i = 0; i < frames; i++) mInterleaved[size_t(i) * mChannels + c] = channels[c][i];
+    }
+    fwrite(mInterleaved.data(), sizeof(float), mInterleaved.size(), mFile);
+    mFrames += frames;
+  }
+
+  void close() {
+    if (!mFile) return;
+    fseek(mFile, 0, SEEK_SET);
+    writeHeader(); // Now with the sizes.
+    fclose(mFile);
+    mFile = nullptr;
+  }
+
+  uint64_t frames() const { return mFrames; }
+
+private:
+  FILE* mFile = nullptr;
+  int mChannels = 0, mSampleRate = 0;
+  uint64_t mFrames = 0;
+  std::vector<float> mInterleaved;
+
+  void u64(uint64_t v) { fwrite(&v, 8, 1, mFile); }
+  void u32(uint32_t v) { fwrite(&v, 4, 1, mFile); }
+  void u16(uint16_t v) { fwrite(&v, 2, 1, mFile); }
+
+  void writeHeader() {
+    bool extensible = mChannels > 2;
+    uint32_t formatSize = extensible ? 40 : 16;
+    uint64_t dataSize = mFrames * mChannels * sizeof(float);
+    uint64_t riffSize = 4 + (8 + 28) + (8 + formatSize) + 8 + dataSize; // WAVE, JUNK or ds64, fmt and data.
+    bool rf64 = riffSize > 0xFFFFFFFFull; // Too big for 32 bit sizes.
+    fwrite(rf64 ? "RF64" : "RIFF", 1, 4, mFile);
+    u32(rf64 ? 0xFFFFFFFFu : uint32_t(riffSize));
+    fwrite("WAVE", 1, 4, mFile);
+    fwrite(rf64 ? "ds64" : "JUNK", 1, 4, mFile); // Room for the 64 bit sizes, skipped by readers while unused.
+    u32(28);
+    u64(rf64 ? riffSize : 0);
+    u64(rf64 ? dataSize : 0);
+    u64(rf64 ? mFrames : 0); // Sample frames.
+    u32(0); // No table of other chunk sizes.
+    fwrite("fmt ", 1, 4, mFile);
+    u32(formatSize);
+    u16(extensible ? 0xFFFE : 3); // WAVE_FORMAT_EXTENSIBLE, or IEEE float.
+    u16(uint16_t(mChannels));
+    u32(uint32_t(mSampleRate));
+    u32(uint32_t(mSampleRate * mChannels * sizeof(float))); // Bytes per second.
+    u16(uint16_t(mChannels * sizeof(float))); // Bytes per frame.
+    u16(32); // Bits per sample.
+    if (extensible) {
+      static const unsigned char floatFormat[16] = {0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+      u16(22); // Size of the extension.
+      u16(32); // Valid bits per sample.
+      u32(0); // No speaker positions, the channels are the speaker layout's own.
+      fwrite(floatFormat, 1, 16, mFile); // IEEE float subformat.
+    }
+    fwrite("data", 1, 4, mFile);
+    u32(rf64 ? 0xFFFFFFFFu : uint32_t(dataSize));
+  }
+};
@@ -2,6 +2,10 @@
 #include "al/app/al_GUIDomain.hpp"
 #include "al/ui/al_ParameterGUI.hpp"
 #include "al_ext/statedistribution/al_CuttleboneDomain.hpp"
+#include "../../harmonicSynth/dynamicResolution.hpp"
+#include "../../harmonicSynth/sceneSdf.hpp"
+#include "../../harmonicSynth/sdfVolume.hpp"
+#include "../../harmonicSynth/shaderWatcher.hpp"
 
 
 using namespace al;
@@ -19,16 +23,23 @@ struct RayApp : public DistributedAppWithState<State> {
   VAOMesh quad;
 
   // our raymarching shader program
-  ShaderProgram rayShader;
+  ShaderSlot rayShader;
+
+  // render the raymarching pass at a scaled resolution chosen from the frame time,
+  // and reconstruct the full resolution image with temporal reprojection
+  ShaderSlot upsampleShader;
+  ResolutionController resolution;
+  TemporalUpsampler upsampler;
+
+  // the scene is static, so bake distfield() into a 3D texture once
+  // and let the shader sample it instead of evaluating it every step
+  SdfBakeCache sdfCache;
+  Texture voxels;
 
   // we will watch and auto reload shader files on change
+  // the watcher runs on its own thread, and only swaps in programs that compile
   SearchPaths searchPaths;
-  struct WatchedFile { 
-    File file;
-    al_sec modified;
-  };
-  std::map<std::string, WatchedFile> watchedFiles;
-  al_sec watchCheckTime;
+  ShaderWatcher shaderWatcher;
 
   // For simple Gui to control parameters
   ControlGUI *gui;
@@ -38,6 +49,9 @@ struct RayApp : public DistributedAppWithState<State> {
   Parameter stepSize{"stepSize", "Raymarching", 0.02, 0.01, 0.1};
   Parameter eyeSep{"eyeSep", "Raymarching", 0.02, 0., 0.5};
   Parameter translucent{"translucent", "Raymarching", 0.5, 0.0, 1.0};
+  ParameterBool dynamicRes{"dynamicRes", "Raymarching", true};
+  Parameter targetFps{"targetFps", "Raymarching", 60.0, 24.0, 120.0};
+  ParameterBool useVolume{"useVolume", "Raymarching", true};
   
 
 
@@ -50,6 +64,7 @@ struct RayApp : public DistributedAppWithState<State> {
     searchPaths.addSearchPath(".", false);
 		searchPaths.addAppPaths();
     searchPaths.addRelativePath("../shaders", true);
+    searchPaths.addRelativePath("../../../harmonicSynth/shaders", false); // upsample.frag is shared with harmonicSynth
     searchPaths.print();
   }
 
@@ -74,28 +89,39 @@ struct RayApp : public DistributedAppWithState<State> {
       auto guiDomain = GUIDomain::enableGUI(defaultWindowDomain());
       gui = &guiDomain->newGUI();
 
-      *gui << maxSteps << stepSize << translucent;
+      *gui << maxSteps << stepSize << translucent << dynamicRes << targetFps << useVolume;
 
     }
 
     // parameters to be available via osc as well as distribute to all nodes
-    parameterServer() << maxSteps << stepSize << translucent; 
+    parameterServer() << maxSteps << stepSize << translucent << dynamicRes << targetFps << useVolume; 
 
     nav().pos(0,0,5);
 
     reloadShaders();
+    bakeScene();
+  }
+
+  // CPU version of distfield() in raymarch.frag, keep the two in sync
+  void bakeScene() {
+    float radius = 0.25;
+    auto distfield = [&](const Vec3f& p) {
+      return std::min(sphereSDF(Vec3f(-0.1, 0, 0), radius, p), sphereSDF(Vec3f(0.1, 0, 0), radius, p));
+    };
+    auto volume = sdfCache.get({radius}, distfield, 64, Vec3f(-1), Vec3f(1));
+    volume->upload(voxels);
   }
 
   void reloadShaders() {
-    loadShader(rayShader, "raymarch.vert", "raymarch.frag");
+    shaderWatcher.searchPaths(&searchPaths);
+    shaderWatcher.add(rayShader, "raymarch.vert", "raymarch.frag");
+    shaderWatcher.add(upsampleShader, "raymarch.vert", "upsample.frag");
+    shaderWatcher.start();
   }
 
   void onAnimate(double dt) override {
 
-    if (watchCheck()) {
-      printf("shader files changed, reloading..\n");
-      reloadShaders();
-    }
+    shaderWatcher.update();
 
     if(isPrimary()){
       state().pose.set(nav());
@@ -103,74 +129,64 @@ struct RayApp : public DistributedAppWithState<State> {
       nav().set(state().pose);
     }
 
+    // feed the controller the raymarch pass's GPU time, the frame time is capped by vsync
+    resolution.targetFps(targetFps);
+    if (dynamicRes) {
+      upsampler.measure(resolution);
+    } else {
+      resolution.reset();
+    }
   }
 
 
-  void onDraw(Graphics &g) override {
-
-    g.clear(0);
-
-    rayShader.use();
-    rayShader.uniform("max_steps", maxSteps)
+  // uniforms shared by the raymarching and upsampling passes
+  void rayUniforms(ShaderProgram& program, Graphics &g) {
+    program.uniform("max_steps", maxSteps)
     .uniform("step_size", stepSize)
     .uniform("translucent", translucent)
     .uniform("eye_sep", g.lens().eyeSep() * g.eye() / 2.0f)
     .uniform("foc_len", g.lens().focalLength())
+    .uniform("jitter", Vec2f(0, 0))
+    .uniform("tex_voxels", 2)
+    .uniform("use_volume", useVolume ? 1 : 0)
     .uniform("al_ProjMatrixInv", Matrix4f::inverse(g.projMatrix()))
     .uniform("al_ViewMatrixInv", Matrix4f::inverse(g.viewMatrix()))
     .uniform("al_ModelMatrixInv", Matrix4f::inverse(g.modelMatrix()))
     .uniform("box_min", Vec3f(-1))  // use a bounding box volume to limit raycasting within this area
     .uniform("box_max", Vec3f(1));
+  }
 
-    quad.draw();
+  void onDraw(Graphics &g) override {
 
-  }
+    g.clear(0);
+    voxels.bind(2);
+
+    if (!dynamicRes) {
+      upsampler.skip(); // so the history isn't stale when it's turned back on
+      rayShader.live().use();
+      rayUniforms(rayShader.live(), g);
+      quad.draw();
+      return;
+    }
 
-  bool onKeyDown(const Keyboard &k) override {}
+    // raymarch into the scaled target, jittered by a sub-pixel offset
+    upsampler.resize(fbWidth(), fbHeight(), resolution);
+    upsampler.views(g.eye()); // one history, so no blending between stereo eyes
+    upsampler.begin(g);
+    rayShader.live().use();
+    rayUniforms(rayShader.live(), g);
+    rayShader.live().uniform("jitter", upsampler.jitter());
+    quad.draw();
+    upsampler.end(g);
 
-  void watchFile(std::string path) {
-    File file(searchPaths.find(path).filepath());
-    watchedFiles[path] = WatchedFile{ file, file.modified() };
-  }
+    // reproject the history and draw the full resolution result
+    upsampleShader.live().use();
+    rayUniforms(upsampleShader.live(), g);
+    upsampler.resolve(g, upsampleShader.live(), quad, g.projMatrix() * g.viewMatrix(), nav().pos());
 
-  bool watchCheck() {
-    bool changed = false;
-    if (floor(al_system_time()) > watchCheckTime) {
-      watchCheckTime = floor(al_system_time());
-      for (std::map <std::string, WatchedFile>::iterator i = watchedFiles.begin(); i != watchedFiles.end(); i++) {
-        WatchedFile& watchedFile = (*i).second;
-        if (watchedFile.modified != watchedFile.file.modified()) {
-          watchedFile.modified = watchedFile.file.modified();
-          changed = true;
-        }
-      }
-    }
-    return changed;
   }
 
-  // read in a .glsl file
-  // add it to the watch list of files
-  // replace shader #include directives with corresponding file code
-  std::string loadGlsl(std::string filename) {
-    watchFile(filename);
-		std::string code = File::read(searchPaths.find(filename).filepath());
-		size_t from = code.find("#include \"");
-		if (from != std::string::npos) {
-			size_t capture = from + strlen("#include \"");
-			size_t to = code.find("\"", capture);
-			std::string include_filename = code.substr(capture, to-capture);
-			std::string replacement = File::read(searchPaths.find(include_filename).filepath());
-			code = code.replace(from, to-from+2, replacement);
-			//printf("code: %s\n", code.data());
-		}
-		return code;
-	}
-
-  void loadShader(ShaderProgram& program, std::string vp_filename, std::string fp_filename) {
-		std::string vp = loadGlsl(vp_filename);
-		std::string fp = loadGlsl(fp_filename);
-		program.compile(vp, fp);
-	}
+  bool onKeyDown(const Keyboard &k) override {}
 
 };
 
@@ -1,6 +1,8 @@
 #version 330
 
-// uniform sampler3D tex_voxels;
+// distance field baked on the CPU, sampled instead of evaluating distfield() when use_volume is set
+uniform sampler3D tex_voxels;
+uniform int use_volume;
 uniform vec3 box_min, box_max;
 uniform int max_steps;
 uniform float step_size;
@@ -68,20 +70,24 @@ void main() {
     float dist_max = boxHit.z;
 
     vec3 box_inverse = 1.0 / box_max;
+    float hit_dist = 0.0; // first distance inside the surface, kept in alpha for temporal reprojection (0 is a miss)
 
 
     for (int i = 0; i < max_steps && dist < dist_max; ++i) {
       vec3 ray_pos = ro + rd * dist;
       ray_pos *= box_inverse;
 
-      // float amt = texture(tex_voxels, ray_pos).r;
-      float d = distfield(ray_pos); // distance to surface within field
-
+      // the volume covers the bounding box, so ray_pos maps straight to texture coordinates
+      float d = use_volume == 1 ? texture(tex_voxels, ray_pos * 0.5 + 0.5).r : distfield(ray_pos); // distance to surface within field
 
       rayColor.rgba = vec4(1.0);
+      if (d < 0.001 && hit_dist == 0.0) hit_dist = max(dist, 0.001);
       
       dist += step_size;      
     }
+
+    // rays through the box that never reach the surface reproject from where they entered it
+    if (rayColor.a > 0.0) rayColor.a = hit_dist > 0.0 ? hit_dist : max(boxHit.y, 0.001);
   }
 
 
@@ -0,0 +1,341 @@
+// Adaptive Subdivision:
+//
+// Chooses, face by face, how finely to subdivide the quad sphere from what the camera sees, so
+// curves can be dense where they're looked at without paying for density everywhere.
+//
+// - Only the faces the cut reaches are subdivided. Catmull-Clark's indexing is known in advance
+//   (child j of face f is face 4f + j, edge e splits into 2e and 2e + 1, and the points of a level's
+//   vertex v, edge e and face f are v, V + e and V + E + f of the next), so any face's corners,
+//   edges and neighbors at any level follow from its parent's, and its positions from its parent's
+//   one ring. Each level keeps what has been derived so far, keyed by index, so splitting a face
+//   costs its own patch, not the level.
+// - The surface is cut into leaves, each a face at some level. A face is split when its projected
+//   size on screen is larger than a pixel threshold, and faces outside the view count as smaller,
+//   so they stay coarse. The camera at the center of the AlloSphere sees every face at about the
+//   same distance, so the view direction does most of the work there.
+// - When the camera moves, the previous cut is refined in place: leaves that are now too big split,
+//   and groups of four siblings that are now small enough merge back into their parent, one level
+//   per update. Leaves stay in depth first order, so the four children of a face are adjacent.
+//
+// Positions are summed in the same order as catmull_clark(), so a face matches the same face of the
+// uniform level exactly. Neighboring leaves at different levels meet with T-junctions, which is fine
+// for points and curves through the face centroids, not for a watertight surface.
+
+#pragma once
+
+#include "quadMesh.hpp" // For the base mesh and the subdivision's indexing.
+#include <algorithm> // For std::max, std::min.
+#include <cmath> // For std::cos, std::sqrt.
+#include <unordered_map> // For the faces derived at each level.
+#include <vector> // For the leaves.
+
+struct quad_leaf {
+  int level; // The subdivision level of the face.
+  int face; // Its index in that level.
+};
+
+struct adaptive_subdivision {
+  float max_pixels = 40.0f; // Faces projected larger than this are split.
+  float outside_scale = 0.2f; // Faces outside the view count as this much smaller.
+  float field_of_view = 1.2f; // Radians across the view, faces outside it plus a margin count as outside.
+  int max_level = 8; // Deepest level a face can reach.
+
+  // Start from every face of a base mesh:
+  void setup(quad_mesh base_mesh) {
+    base = std::move(base_mesh);
+    levels.assign(1, sparse_level());
+    levels[0].vertex_count = base.vertex_count();
+    levels[0].edge_count = base.edge_count();
+    levels[0].face_count = base.face_count();
+    leaves.clear();
+    for (int f = 0; f < base.face_count(); f++) leaves.push_back({0, f});
+    changed = true;
+  }
+
+  // Faces derived below the base so far, at every level:
+  size_t cached_faces() const {
+    size_t count = 0;
+    for (const sparse_level& level : levels) count += level.faces.size();
+    return count;
+  }
+
+  // Refine the previous cut for a camera position and forward direction. pixels_per_radian is the
+  // viewport's height over its vertical field of view. Returns whether the cut changed:
+  bool update(const al::Vec3f& camera, const al::Vec3f& forward, float pixels_per_radian) {
+    eye = camera;
+    view = forward;
+    view.normalize();
+    scale = pixels_per_radian;
+    cos_view = std::cos(std::min(0.5f * field_of_view + 0.3f, 3.14159265f)); // With a margin, so turning doesn't show coarse faces.
+    changed = false;
+    level(max_level); // Every level's counts up front, so the levels don't move while faces are derived.
+    next.clear();
+    for (size_t i = 0; i < leaves.size(); i++) {
+      quad_leaf leaf = leaves[i];
+      if (leaf.level > 0 && leaf.face % 4 == 0 && i + 3 < leaves.size() && siblings(i) && !needs_split(leaf.level - 1, leaf.face / 4)) {
+        next.push_back({leaf.level - 1, leaf.face / 4}); // Merge the four siblings back into their parent.
+        i += 3;
+        changed = true;
+      } else {
+        split(leaf); // Keep it, or split it as far as it needs.
+      }
+    }
+    std::swap(leaves, next);
+    return changed;
+  }
+
+  // The centroid of every leaf, in depth first order:
+  void centroids(std::vector<al::Vec3f>& out) {
+    out.resize(leaves.size());
+    for (size_t i = 0; i < leaves.size(); i++) out[i] = centroid(leaves[i].level, leaves[i].face);
+  }
+
+  // The four corners of every leaf:
+  void corners(std::vector<al::Vec3f>& out) {
+    out.resize(4 * leaves.size());
+    for (size_t i = 0; i < leaves.size(); i++) {
+      const sparse_face& face = this->face(leaves[i].level, leaves[i].face);
+      for (int j = 0; j < 4; j++) out[4 * i + j] = position(leaves[i].level, face.vertices[j]);
+    }
+  }
+
+  std::vector<quad_leaf> leaves; // The current cut, in depth first order.
+
+private:
+  struct sparse_face {
+    int vertices[4]; // In winding order.
+    int edges[4]; // Edge j joins corners j and j + 1.
+  };
+  struct sparse_edge {
+    int vertices[2];
+    int faces[2]; // -1 where an edge has only one face.
+  };
+  struct sparse_vertex {
+    std::vector<int> edges, faces; // Around it, in catmull_clark()'s order.
+    al::Vec3f position;
+    bool placed = false; // Whether position has been computed yet.
+  };
+  // What has been derived of one level, by index:
+  struct sparse_level {
+    int vertex_count = 0, edge_count = 0, face_count = 0; // Of the whole level.
+    std::unordered_map<int, sparse_face> faces;
+    std::unordered_map<int, sparse_edge> edges;
+    std::unordered_map<int, sparse_vertex> vertices;
+    std::unordered_map<int, al::Vec3f> centroids;
+  };
+
+  quad_mesh base;
+  std::vector<sparse_level> levels; // Level 0 reads the base, the others hold what's been derived.
+  std::vector<quad_leaf> next; // The cut being built.
+  al::Vec3f eye, view;
+  float scale = 1.0f, cos_view = 0.0f;
+  bool changed = true;
+
+  // The level's record, counting its size from the one before the first time it's reached:
+  sparse_level& level(int l) {
+    while (int(levels.size()) <= l) {
+      const sparse_level& last = levels.back();
+      sparse_level next_level;
+      next_level.vertex_count = last.vertex_count + last.edge_count + last.face_count;
+      next_level.edge_count = 2 * last.edge_count + 4 * last.face_count;
+      next_level.face_count = 4 * last.face_count;
+      levels.push_back(std::move(next_level));
+    }
+    return levels[l];
+  }
+
+  // A face's corners and edges, from its parent's, as catmull_clark() numbers them:
+  const sparse_face& face(int l, int f) {
+    sparse_level& here = level(l);
+    auto found = here.faces.find(f);
+    if (found != here.faces.end()) return found->second;
+    sparse_face result;
+    if (l == 0) {
+      for (int j = 0; j < 4; j++) {
+        result.vertices[j] = base.face_vertices[4 * f + j];
+        result.edges[j] = base.face_edges[4 * f + j];
+      }
+    } else {
+      const sparse_level& above = levels[l - 1];
+      int edge_base = above.vertex_count, face_base = above.vertex_count + above.edge_count, inner_base = 2 * above.edge_count;
+      int parent = f / 4, j = f % 4;
+      const sparse_face& p = face(l - 1, parent);
+      int corner = p.vertices[j], after = p.edges[j], before = p.edges[(j + 3) % 4];
+      result.vertices[0] = corner;
+      result.vertices[1] = edge_base + after;
+      result.vertices[2] = face_base + parent;
+      result.vertices[3] = edge_base + before;
+      result.edges[0] = 2 * after + (edge(l - 1, after).vertices[0] == corner ? 0 : 1); // The half of the edge on the corner's side.
+      result.edges[1] = inner_base + 4 * parent + j;
+      result.edges[2] = inner_base + 4 * parent + (j + 3) % 4;
+      result.edges[3] = 2 * before + (edge(l - 1, before).vertices[0] == corner ? 0 : 1);
+    }
+    return levels[l].faces.emplace(f, result).first->second;
+  }
+
+  // The slot of a corner in a face:
+  int corner_slot(int l, int f, int v) {
+    const int* corner = face(l, f).vertices;
+    return corner[0] == v ? 0 : corner[1] == v ? 1 : corner[2] == v ? 2 : 3;
+  }
+
+  // An edge's ends and faces, from its parent edge's, or from the face it's inside:
+  const sparse_edge& edge(int l, int e) {
+    sparse_level& here = level(l);
+    auto found = here.edges.find(e);
+    if (found != here.edges.end()) return found->second;
+    sparse_edge result;
+    if (l == 0) {
+      for (int k = 0; k < 2; k++) {
+        result.vertices[k] = base.edge_vertices[2 * e + k];
+        result.faces[k] = base.edge_faces[2 * e + k];
+      }
+    } else {
+      const sparse_level& above = levels[l - 1];
+      int edge_base = above.vertex_count, inner_base = 2 * above.edge_count;
+      if (e < inner_base) { // Half of an edge, on the side of its first vertex for 2e.
+        int whole = e / 2, half = e % 2;
+        const sparse_edge& parent = edge(l - 1, whole);
+        int end = parent.vertices[half];
+        result.vertices[0] = half == 0 ? end : edge_base + whole;
+        result.vertices[1] = half == 0 ? edge_base + whole : end;
+        for (int k = 0; k < 2; k++) { // The children at its vertex, in the faces on either side.
+          int f = parent.faces[k];
+          result.faces[k] = f >= 0 ? 4 * f + corner_slot(l - 1, f, end) : -1;
+        }
+      } else { // From an edge point to its face point.
+        int parent = (e - inner_base) / 4, j = (e - inner_base) % 4;
+        result.vertices[0] = edge_base + face(l - 1, parent).edges[j];
+        result.vertices[1] = edge_base + above.edge_count + parent;
+        result.faces[0] = 4 * parent + j;
+        result.faces[1] = 4 * parent + (j + 1) % 4;
+      }
+    }
+    return levels[l].edges.emplace(e, result).first->second;
+  }
+
+  // A vertex's edges and faces, as build_child_neighbors() finds them, without its position:
+  sparse_vertex& vertex(int l, int v) {
+    sparse_level& here = level(l);
+    auto found = here.vertices.find(v);
+    if (found != here.vertices.end()) return found->second;
+    sparse_vertex result;
+    if (l == 0) {
+      result.edges.assign(base.edges_of(v), base.edges_of(v) + base.edge_valence(v));
+      result.faces.assign(base.faces_of(v), base.faces_of(v) + base.face_valence(v));
+      result.position = base.positions[v];
+      result.placed = true;
+    } else {
+      const sparse_level& above = levels[l - 1];
+      int edge_base = above.vertex_count, face_base = above.vertex_count + above.edge_count, inner_base = 2 * above.edge_count;
+      if (v < edge_base) { // A vertex point keeps its vertex's neighbors.
+        const sparse_vertex& parent = vertex(l - 1, v);
+        for (int e : parent.edges) result.edges.push_back(2 * e + (edge(l - 1, e).vertices[0] == v ? 0 : 1));
+        for (int f : parent.faces) result.faces.push_back(4 * f + corner_slot(l - 1, f, v));
+      } else if (v < face_base) { // An edge point has both halves of its edge, and a face and an inner edge per side.
+        int e = v - edge_base;
+        result.edges = {2 * e, 2 * e + 1};
+        for (int k = 0; k < 2; k++) {
+          int f = edge(l - 1, e).faces[k];
+          if (f < 0) continue;
+          int slot = 0;
+          while (face(l - 1, f).edges[slot] != e) slot++;
+          result.edges.push_back(inner_base + 4 * f + slot);
+          result.faces.push_back(4 * f + slot);
+          result.faces.push_back(4 * f + (slot + 1) % 4);
+        }
+      } else { // A face point has its face's four inner edges and four children.
+        int f = v - face_base;
+        for (int j = 0; j < 4; j++) {
+          result.edges.push_back(inner_base + 4 * f + j);
+          result.faces.push_back(4 * f + j);
+        }
+      }
+    }
+    return levels[l].vertices.emplace(v, std::move(result)).first->second;
+  }
+
+  // A vertex's position, from the one ring of its parent vertex, edge or face:
+  al::Vec3f position(int l, int v) {
+    sparse_vertex& here = vertex(l, v);
+    if (here.placed) return here.position;
+    const sparse_level& above = levels[l - 1];
+    int edge_base = above.vertex_count, face_base = above.vertex_count + above.edge_count;
+    al::Vec3f result;
+    if (v < edge_base) { // The barycenter of the face centroids, edge midpoints and original position.
+      const sparse_vertex& parent = vertex(l - 1, v);
+      al::Vec3f edge_sum = 0.0f, face_sum = 0.0f;
+      int n = int(parent.edges.size());
+      for (int e : parent.edges) edge_sum += midpoint(l - 1, e);
+      for (int f : parent.faces) face_sum += centroid(l - 1, f);
+      al::Vec3f edge_avg = edge_sum / float(n);
+      al::Vec3f face_avg = face_sum / float(parent.faces.size());
+      result = (face_avg + 2.0f * edge_avg + (float(n) - 3.0f) * position(l - 1, v)) / float(n);
+    } else if (v < face_base) { // The edge's two vertices and its neighboring face centroids.
+      int e = v - edge_base;
+      sparse_edge parent = edge(l - 1, e);
+      al::Vec3f sum = position(l - 1, parent.vertices[0]) + position(l - 1, parent.vertices[1]);
+      float count = 2.0f;
+      for (int k = 0; k < 2; k++) {
+        if (parent.faces[k] >= 0) {
+          sum += centroid(l - 1, parent.faces[k]);
+          count += 1.0f;
+        }
+      }
+      result = sum / count;
+    } else { // The face's centroid.
+      result = centroid(l - 1, v - face_base);
+    }
+    here.position = result; // Still in place, the maps only grow.
+    here.placed = true;
+    return result;
+  }
+
+  al::Vec3f midpoint(int l, int e) {
+    sparse_edge ends = edge(l, e);
+    return (position(l, ends.vertices[0]) + position(l, ends.vertices[1])) / 2.0f;
+  }
+
+  al::Vec3f centroid(int l, int f) {
+    if (l == 0) return base.centroids[f];
+    sparse_level& here = level(l);
+    auto found = here.centroids.find(f);
+    if (found != here.centroids.end()) return found->second;
+    sparse_face corners = face(l, f);
+    al::Vec3f result = (position(l, corners.vertices[0]) + position(l, corners.vertices[1]) + position(l, corners.vertices[2]) + position(l, corners.vertices[3])) / 4.0f;
+    here.centroids.emplace(f, result);
+    return result;
+  }
+
+  // Whether leaf i and the three after it are the four children of one face:
+  bool siblings(size_t i) const {
+    for (int j = 1; j < 4; j++) {
+      if (leaves[i + j].level != leaves[i].level || leaves[i + j].face != leaves[i].face + j) return false;
+    }
+    return true;
+  }
+
+  // Whether a face is too big on screen:
+  bool needs_split(int l, int f) {
+    if (l >= max_level) return false;
+    al::Vec3f center = centroid(l, f);
+    sparse_face corners = face(l, f);
+    float radius = 0.0f; // Size of the face, from its centroid to its farthest corner.
+    for (int j = 0; j < 4; j++) radius = std::max(radius, (position(l, corners.vertices[j]) - center).mag());
+    al::Vec3f to_face = center - eye;
+    float distance = std::max(to_face.mag(), 1e-4f);
+    float pixels = 2.0f * radius / distance * scale; // Its projected size.
+    if (to_face.dot(view) < cos_view * distance) pixels *= outside_scale; // Out of view.
+    return pixels > max_pixels;
+  }
+
+  // Add a face to the next cut, split into its children for as long as they're too big:
+  void split(quad_leaf leaf) {
+    if (!needs_split(leaf.level, leaf.face)) {
+      next.push_back(leaf);
+      return;
+    }
+    changed = true;
+    for (int j = 0; j < 4; j++) split({leaf.level + 1, 4 * leaf.face + j});
+  }
+};
@@ -0,0 +1,245 @@
+// Geometry Cache:
+//
+// Saves a subdivided mesh and its curve to a binary file named by what generated them (level, seed
+// and cube size), so later launches, and every render node, map the file instead of subdividing
+// and searching again.
+//
+// - The file is a header, a table of arrays, then the arrays themselves, each the same flat array
+//   quad_mesh keeps in memory, starting on a 64 byte boundary. Mapping the file gives pointers
+//   straight into it, with no parsing and no copies.
+// - The header has a magic number, a format version, the byte order and the generation parameters.
+//   A file that doesn't match any of them, or is shorter than its table says, is ignored and
+//   regenerated, so changing the format only needs a new version number.
+// - Files are written to a temporary name and renamed into place, so a node never maps a file
+//   another node is still writing.
+
+#pragma once
+
+#include "quadMesh.hpp" // For the mesh arrays.
+#include "hamiltonianCurve.hpp" // For generating the curve when it isn't cached.
+#include <cstdint> // For the fixed size header fields.
+#include <cstdio> // For writing and renaming files.
+#include <cstring> // For std::memcmp.
+#include <string> // For paths.
+#include <vector> // For the arrays.
+#ifdef _WIN32
+#include <fstream> // For reading the whole file where there's no mmap.
+#else
+#include <fcntl.h> // For open.
+#include <sys/mman.h> // For mmap.
+#include <sys/stat.h> // For fstat.
+#include <unistd.h> // For close, getpid.
+#endif
+
+// What a cached mesh and curve were generated from:
+struct geometry_key {
+  int level = 0; // Subdivision level of the cube.
+  uint32_t seed = 0; // Seed of the curve.
+  float cube_size = 1.0f;
+};
+
+// The arrays in a cache file, in order:
+enum geometry_array {
+  positions_array, vertex_edge_offsets_array, vertex_edges_array, vertex_face_offsets_array, vertex_faces_array,
+  midpoints_array, edge_vertices_array, edge_faces_array,
+  centroids_array, face_vertices_array, face_edges_array, face_parents_array,
+  curve_order_array, curve_points_array,
+  geometry_array_count
+};
+
+struct geometry_header {
+  char magic[4]; // "SFCG".
+  uint32_t version; // Bumped whenever the layout or the generators change.
+  uint32_t byte_order; // 0x01020304 as written, to reject files from a machine of the other endianness.
+  int32_t level;
+  uint32_t seed;
+  float cube_size;
+  uint32_t array_count;
+  uint32_t reserved;
+};
+
+struct geometry_array_entry {
+  uint64_t offset; // Bytes from the start of the file.
+  uint64_t count; // Elements.
+  uint32_t element_size; // Bytes per element, checked on load.
+  uint32_t reserved;
+};
+
+constexpr uint32_t geometry_cache_version = 1;
+
+// The cache file for a key, in a directory:
+inline std::string geometry_cache_path(const std::string& directory, const geometry_key& key) {
+  char name[96];
+  snprintf(name, sizeof(name), "sfc_level%d_seed%u_size%g.bin", key.level, key.seed, key.cube_size);
+  return directory.empty() ? std::string(name) : directory + "/" + name;
+}
+
+// Write a mesh and its curve to a cache file. Returns false if it couldn't be written:
+inline bool save_geometry(const std::string& path, const geometry_key& key, const quad_mesh& mesh, const std::vector<int>& order, const std::vector<al::Vec3f>& points) {
+  struct source { const void* data; uint64_t count; uint32_t element_size; };
+  auto vec3 = [](const std::vector<al::Vec3f>& v) { return source{v.data(), v.size(), uint32_t(sizeof(al::Vec3f))}; };
+  auto ints = [](const std::vector<int>& v) { return source{v.data(), v.size(), uint32_t(sizeof(int))}; };
+  source sources[geometry_array_count] = {
+    vec3(mesh.positions), ints(mesh.vertex_edge_offsets), ints(mesh.vertex_edges), ints(mesh.vertex_face_offsets), ints(mesh.vertex_faces),
+    vec3(mesh.midpoints), ints(mesh.edge_vertices), ints(mesh.edge_faces),
+    vec3(mesh.centroids), ints(mesh.face_vertices), ints(mesh.face_edges), ints(mesh.face_parents),
+    ints(order), vec3(points)
+  };
+
+  geometry_header header = {{'S', 'F', 'C', 'G'}, geometry_cache_version, 0x01020304u, key.level, key.seed, key.cube_size, uint32_t(geometry_array_count), 0};
+  geometry_array_entry table[geometry_array_count];
+  uint64_t offset = sizeof(header) + sizeof(table);
+  for (int a = 0; a < geometry_array_count; a++) {
+    offset = (offset + 63) & ~uint64_t(63); // Each array on its own cache line.
+    table[a] = {offset, sources[a].count, sources[a].element_size, 0};
+    offset += sources[a].count * sources[a].element_size;
+  }
+
+#ifdef _WIN32
+  std::string temporary = path + ".tmp";
+#else
+  std::string temporary = path + "." + std::to_string(getpid()) + ".tmp"; // Unique per process, for nodes sharing a directory.
+#endif
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if (!file) return false;
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(table, sizeof(table), 1, file) == 1;
+  uint64_t position = sizeof(header) + sizeof(table);
+  static const char padding[64] = {};
+  for (int a = 0; a < geometry_array_count && written; a++) {
+    written = position == table[a].offset || fwrite(padding, table[a].offset - position, 1, file) == 1;
+    uint64_t bytes = table[a].count * table[a].element_size;
+    written = written && (bytes == 0 || fwrite(sources[a].data, bytes, 1, file) == 1);
+    position = table[a].offset + bytes;
+  }
+  written = fclose(file) == 0 && written;
+  if (written) {
+#ifdef _WIN32
+    std::remove(path.c_str()); // Windows won't rename over a file.
+#endif
+    written = std::rename(temporary.c_str(), path.c_str()) == 0;
+  }
+  if (!written) std::remove(temporary.c_str());
+  return written;
+}
+
+// A cache file mapped into memory, its arrays read in place:
+struct mapped_geometry {
+  mapped_geometry() = default;
+  mapped_geometry(const mapped_geometry&) = delete;
+  mapped_geometry& operator=(const mapped_geometry&) = delete;
+  ~mapped_geometry() { close(); }
+
+  // Map a cache file, if it exists and matches the key and this version:
+  bool open(const std::string& path, const geometry_key& key) {
+    close();
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    buffer.resize(size_t(file.tellg()));
+    file.seekg(0);
+    if (!file.read(buffer.data(), buffer.size())) return false;
+    bytes = reinterpret_cast<const unsigned char*>(buffer.data());
+    size = buffer.size();
+#else
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat status;
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+      void* mapped = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+      if (mapped != MAP_FAILED) {
+        bytes = static_cast<const unsigned char*>(mapped);
+        size = size_t(status.st_size);
+      }
+    }
+    ::close(descriptor); // The mapping stays valid without it.
+    if (!bytes) return false;
+#endif
+    if (!valid(key)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+#ifndef _WIN32
+    if (bytes) munmap(const_cast<unsigned char*>(bytes), size);
+#endif
+    buffer.clear();
+    bytes = nullptr;
+    size = 0;
+  }
+
+  bool is_open() const { return bytes != nullptr; }
+
+  // An array in place, and its number of elements:
+  template <typename T>
+  const T* array(geometry_array a, size_t& count) const {
+    const geometry_array_entry& entry = table()[a];
+    count = size_t(entry.count);
+    return reinterpret_cast<const T*>(bytes + entry.offset);
+  }
+
+  const al::Vec3f* curve_points(size_t& count) const { return array<al::Vec3f>(curve_points_array, count); }
+  const int* curve_order(size_t& count) const { return array<int>(curve_order_array, count); }
+
+  // Copy the mesh out, for when it has to be changed or subdivided further:
+  void load_mesh(quad_mesh& mesh) const {
+    auto vec3 = [&](geometry_array a, std::vector<al::Vec3f>& out) {
+      size_t count;
+      const al::Vec3f* data = array<al::Vec3f>(a, count);
+      out.assign(data, data + count);
+    };
+    auto ints = [&](geometry_array a, std::vector<int>& out) {
+      size_t count;
+      const int* data = array<int>(a, count);
+      out.assign(data, data + count);
+    };
+    vec3(positions_array, mesh.positions);
+    ints(vertex_edge_offsets_array, mesh.vertex_edge_offsets);
+    ints(vertex_edges_array, mesh.vertex_edges);
+    ints(vertex_face_offsets_array, mesh.vertex_face_offsets);
+    ints(vertex_faces_array, mesh.vertex_faces);
+    vec3(midpoints_array, mesh.midpoints);
+    ints(edge_vertices_array, mesh.edge_vertices);
+    ints(edge_faces_array, mesh.edge_faces);
+    vec3(centroids_array, mesh.centroids);
+    ints(face_vertices_array, mesh.face_vertices);
+    ints(face_edges_array, mesh.face_edges);
+    ints(face_parents_array, mesh.face_parents);
+  }
+
+private:
+  const unsigned char* bytes = nullptr;
+  size_t size = 0;
+  std::vector<char> buffer; // The file's contents where it's read rather than mapped.
+
+  const geometry_header& header() const { return *reinterpret_cast<const geometry_header*>(bytes); }
+  const geometry_array_entry* table() const { return reinterpret_cast<const geometry_array_entry*>(bytes + sizeof(geometry_header)); }
+
+  // Whether the mapped file is this version, for this key, and holds every array it lists:
+  bool valid(const geometry_key& key) const {
+    if (size < sizeof(geometry_header) + geometry_array_count * sizeof(geometry_array_entry)) return false;
+    const geometry_header& h = header();
+    if (std::memcmp(h.magic, "SFCG", 4) != 0 || h.version != geometry_cache_version || h.byte_order != 0x01020304u) return false;
+    if (h.level != key.level || h.seed != key.seed || h.cube_size != key.cube_size || h.array_count != uint32_t(geometry_array_count)) return false;
+    for (int a = 0; a < geometry_array_count; a++) {
+      const geometry_array_entry& entry = table()[a];
+      uint32_t expected = a == positions_array || a == midpoints_array || a == centroids_array || a == curve_points_array ? sizeof(al::Vec3f) : sizeof(int);
+      if (entry.element_size != expected || entry.offset % 64 != 0 || entry.offset > size || entry.count > (size - entry.offset) / expected) return false;
+    }
+    return true;
+  }
+};
+
+// Map the cube's mesh and curve for a key from a directory, generating and saving them first if
+// they aren't cached yet. Returns false only if they could be neither loaded nor saved, in which
+// case mesh, order and points still hold the generated geometry:
+inline bool cached_curve(const std::string& directory, const geometry_key& key, mapped_geometry& cache,
+                         quad_mesh& mesh, std::vector<int>& order, std::vector<al::Vec3f>& points) {
+  std::string path = geometry_cache_path(directory, key);
+  if (cache.open(path, key)) return true;
+  space_filling_curve(create_cube(key.cube_size), key.level, key.seed, mesh, order);
+  curve_points(mesh, order, points);
+  return save_geometry(path, key, mesh, order, points) && cache.open(path, key);
+}
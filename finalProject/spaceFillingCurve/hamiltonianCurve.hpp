@@ -0,0 +1,225 @@
+// Hamiltonian Curve:
+//
+// Builds a single closed curve through the centroid of every face of a subdivided quad mesh, each
+// step crossing an edge to a neighboring face, so the curve never crosses itself (tasks 4 and 5).
+//
+// - Splitting a face into four gives four children around its center, which already form a small
+//   cycle. Two neighboring faces' cycles are joined into one by swapping the cycle edges along
+//   their shared edge for two edges across it, the children at the same vertex connected to each
+//   other. Joining along every edge of a spanning tree of the coarse faces leaves one cycle through
+//   every fine face, in one parallel pass over the edges.
+// - Without a seed the tree is the previous level's curve, less its closing step, so each level
+//   refines the curve before it face by face, like a Hilbert curve. With a seed the tree is chosen
+//   at random level by level: three of the four children of each face joined inside it, and each
+//   coarse tree edge split into one of its two halves, so the variants stay self similar.
+// - Child j of face f is face 4f + j and half h of edge e is edge 2e + h, so every choice is an
+//   index computed in place, hashed from the seed rather than drawn in order, and the same seed
+//   gives the same curve on any number of threads.
+//
+// Each level is linear in the number of faces. Only walking the final cycle into an order is serial.
+
+#pragma once
+
+#include "quadMesh.hpp" // For the faces and their subdivision.
+#include "parallelFor.hpp" // For joining cycles on every core.
+#include <algorithm> // For std::max, std::sort.
+#include <chrono> // For the benchmark.
+#include <cstdint> // For the hashes.
+#include <cstdio> // For the benchmark's report.
+#include <numeric> // For std::iota.
+#include <vector> // For the trees and cycles.
+
+// A random number from a seed, a level and an index, the same whichever thread asks:
+inline uint64_t curve_hash(uint32_t seed, int level, int index) {
+  uint64_t x = (uint64_t(seed) << 32) ^ (uint64_t(level) << 27) ^ uint64_t(uint32_t(index));
+  x += 0x9e3779b97f4a7c15ull; // Splitmix64.
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// Mark a spanning tree of the base mesh's faces, in tree, one flag per edge. Without a seed, a
+// depth first search from face 0, with one, random edges joined while they connect new faces:
+inline void base_tree(const quad_mesh& base, uint32_t seed, std::vector<char>& tree) {
+  int faces = base.face_count(), edges = base.edge_count();
+  tree.assign(edges, 0);
+  if (seed == 0) {
+    std::vector<char> visited(faces, 0);
+    std::vector<int> stack(1, 0);
+    visited[0] = 1;
+    while (!stack.empty()) {
+      int f = stack.back(), j = 0;
+      for (; j < 4; j++) { // The first unvisited neighbor...
+        int e = base.face_edges[4 * f + j];
+        int g = base.edge_faces[2 * e] == f ? base.edge_faces[2 * e + 1] : base.edge_faces[2 * e];
+        if (g >= 0 && !visited[g]) {
+          visited[g] = 1;
+          tree[e] = 1;
+          stack.push_back(g);
+          break;
+        }
+      }
+      if (j == 4) stack.pop_back(); // ...or back up.
+    }
+    return;
+  }
+  std::vector<int> order(edges), group(faces);
+  std::iota(order.begin(), order.end(), 0);
+  std::iota(group.begin(), group.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int a, int b) { return curve_hash(seed, 0, a) < curve_hash(seed, 0, b); });
+  auto find = [&](int f) {
+    while (group[f] != f) f = group[f] = group[group[f]];
+    return f;
+  };
+  for (int e : order) { // Random order, joining faces not yet connected.
+    int f = base.edge_faces[2 * e], g = base.edge_faces[2 * e + 1];
+    if (f < 0 || g < 0 || find(f) == find(g)) continue;
+    group[find(f)] = find(g);
+    tree[e] = 1;
+  }
+}
+
+// Mark the edges between consecutive faces of a cycle, less its closing step, which is a tree:
+inline void tree_from_cycle(const quad_mesh& mesh, const std::vector<int>& order, std::vector<char>& tree) {
+  tree.assign(mesh.edge_count(), 0);
+  parallel_for(int(order.size()) - 1, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      int f = order[i], g = order[i + 1];
+      for (int j = 0; j < 4; j++) {
+        int e = mesh.face_edges[4 * f + j];
+        if (mesh.edge_faces[2 * e] == g || mesh.edge_faces[2 * e + 1] == g) tree[e] = 1;
+      }
+    }
+  });
+}
+
+// Spread a random tree of a mesh's faces to its subdivision: inside each face, three of the four
+// edges between its children, and across each tree edge, one of its two halves:
+inline void refine_tree(const quad_mesh& input, uint32_t seed, int level, const std::vector<char>& tree, std::vector<char>& output) {
+  int edges = input.edge_count(), faces = input.face_count(), inner_base = 2 * edges;
+  output.resize(2 * edges + 4 * faces);
+  parallel_for(edges, [&](int begin, int end) {
+    for (int e = begin; e < end; e++) {
+      int half = int(curve_hash(seed, level, e) & 1);
+      output[2 * e + half] = tree[e];
+      output[2 * e + 1 - half] = 0;
+    }
+  });
+  parallel_for(faces, [&](int begin, int end) {
+    for (int f = begin; f < end; f++) {
+      int dropped = int(curve_hash(seed, level, edges + f) & 3);
+      for (int j = 0; j < 4; j++) output[inner_base + 4 * f + j] = j != dropped;
+    }
+  });
+}
+
+// Join the children of every face into one cycle along a tree of the faces. links holds the two
+// neighbors of each child in the cycle, slot 0 toward the child before it around its parent and
+// slot 1 toward the one after, until a join replaces them:
+inline void cycle_from_tree(const quad_mesh& input, const std::vector<char>& tree, std::vector<int>& links) {
+  int faces = input.face_count(), edges = input.edge_count();
+  links.resize(8 * faces);
+  parallel_for(faces, [&](int begin, int end) { // A small cycle around each face's center...
+    for (int f = begin; f < end; f++) {
+      for (int j = 0; j < 4; j++) {
+        links[2 * (4 * f + j)] = 4 * f + (j + 3) % 4;
+        links[2 * (4 * f + j) + 1] = 4 * f + (j + 1) % 4;
+      }
+    }
+  });
+  parallel_for(edges, [&](int begin, int end) { // ...joined across every tree edge.
+    for (int e = begin; e < end; e++) {
+      if (!tree[e]) continue;
+      for (int k = 0; k < 2; k++) {
+        int f = input.edge_faces[2 * e + k], g = input.edge_faces[2 * e + 1 - k];
+        if (f < 0 || g < 0) break;
+        int side = 0;
+        while (input.face_edges[4 * f + side] != e) side++;
+        int next = (side + 1) % 4; // The children at the side's two corners, each joined to g's child at the same corner.
+        links[2 * (4 * f + side) + 1] = 4 * g + corner_slot(input, g, input.face_vertices[4 * f + side]);
+        links[2 * (4 * f + next)] = 4 * g + corner_slot(input, g, input.face_vertices[4 * f + next]);
+      }
+    }
+  });
+}
+
+// Walk a cycle's links from face 0 into the order of its faces:
+inline void walk_cycle(const std::vector<int>& links, std::vector<int>& order) {
+  int count = int(links.size() / 2);
+  order.resize(count);
+  int previous = 0, current = links[1];
+  order[0] = 0;
+  for (int i = 1; i < count; i++) {
+    order[i] = current;
+    int next = links[2 * current] == previous ? links[2 * current + 1] : links[2 * current];
+    previous = current;
+    current = next;
+  }
+}
+
+// Subdivide a base mesh some levels, at least one, into mesh, and find a closed curve through all
+// of its faces, in order. Seed 0 is the hierarchical curve, any other seed a random variant:
+inline void space_filling_curve(const quad_mesh& base, int levels, uint32_t seed, quad_mesh& mesh, std::vector<int>& order) {
+  levels = std::max(levels, 1);
+  quad_mesh next;
+  mesh = base;
+  reserve_levels(mesh, base, levels);
+  reserve_levels(next, base, levels);
+  std::vector<char> tree, next_tree;
+  std::vector<int> links;
+  base_tree(mesh, seed, tree);
+  for (int level = 1; level <= levels; level++) {
+    if (seed == 0 || level == levels) cycle_from_tree(mesh, tree, links); // A random tree only needs its last cycle.
+    if (seed != 0 && level < levels) {
+      refine_tree(mesh, seed, level, tree, next_tree);
+      std::swap(tree, next_tree);
+    }
+    catmull_clark(mesh, next);
+    std::swap(mesh, next);
+    if (seed == 0 && level < levels) { // The curve so far is the next level's tree.
+      walk_cycle(links, order);
+      tree_from_cycle(mesh, order, tree);
+    }
+  }
+  walk_cycle(links, order);
+}
+
+// The curve's points, the centroid of each face in order:
+inline void curve_points(const quad_mesh& mesh, const std::vector<int>& order, std::vector<al::Vec3f>& points) {
+  points.resize(order.size());
+  parallel_for(int(order.size()), [&](int begin, int end) {
+    for (int i = begin; i < end; i++) points[i] = mesh.centroids[order[i]];
+  });
+}
+
+// Whether an order visits every face once, each step, closing step included, to a neighbor:
+inline bool valid_curve(const quad_mesh& mesh, const std::vector<int>& order) {
+  if (int(order.size()) != mesh.face_count()) return false;
+  std::vector<char> seen(order.size(), 0);
+  for (size_t i = 0; i < order.size(); i++) {
+    int f = order[i], g = order[(i + 1) % order.size()];
+    if (f < 0 || f >= mesh.face_count() || seen[f]) return false;
+    seen[f] = 1;
+    bool neighbors = false;
+    for (int j = 0; j < 4; j++) {
+      int e = mesh.face_edges[4 * f + j];
+      neighbors = neighbors || mesh.edge_faces[2 * e] == g || mesh.edge_faces[2 * e + 1] == g;
+    }
+    if (!neighbors) return false;
+  }
+  return true;
+}
+
+// Time the curve over the cube level by level, with and without a seed:
+inline void benchmark_curves(int max_level = 8) {
+  quad_mesh cube = create_cube(1.0f), mesh;
+  std::vector<int> order;
+  for (int level = 1; level <= max_level; level++) {
+    for (uint32_t seed : {0u, 1u}) {
+      auto start = std::chrono::steady_clock::now();
+      space_filling_curve(cube, level, seed, mesh, order);
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      printf("curve level %d seed %u: %d faces in %.2f ms, %s\n", level, seed, mesh.face_count(), ms, valid_curve(mesh, order) ? "valid" : "INVALID");
+    }
+  }
+}
@@ -0,0 +1,75 @@
+// Parallel For:
+//
+// Splits a loop over contiguous arrays across threads, for the mesh and curve generators.
+//
+// - parallel_for() cuts a range into one contiguous chunk per thread and runs the body on each
+//   chunk. Small ranges run on the calling thread, where starting threads would cost more than
+//   the work.
+// - parallel_prefix_sum() turns counts into offsets in place (an exclusive scan), in two passes
+//   over per-thread chunks, so variable sized outputs can be written in parallel without locks.
+//
+// Threads are started per call, which costs tens of microseconds, so each call should carry a
+// whole stage of work rather than one element.
+
+#pragma once
+
+#include <algorithm> // For std::min, std::max.
+#include <cstdint> // For int64_t.
+#include <thread> // For std::thread.
+#include <vector> // For the threads and chunk sums.
+
+// Number of threads to use, 0 for every hardware thread:
+inline int& parallel_threads() {
+  static int threads = 0;
+  return threads;
+}
+
+// Number of threads a range of some size would be split across:
+inline int parallel_chunks(int count, int grain) {
+  int threads = parallel_threads() > 0 ? parallel_threads() : int(std::max(std::thread::hardware_concurrency(), 1u));
+  return std::max(1, std::min(threads, count / std::max(grain, 1)));
+}
+
+// Run body(begin, end) over contiguous chunks of [0, count), in parallel when there is enough work:
+template <typename Body>
+void parallel_for(int count, Body body, int grain = 4096) {
+  int chunks = parallel_chunks(count, grain);
+  if (chunks <= 1) {
+    if (count > 0) body(0, count);
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(chunks - 1);
+  for (int c = 1; c < chunks; c++) { // The calling thread takes the first chunk.
+    int begin = int(int64_t(count) * c / chunks), end = int(int64_t(count) * (c + 1) / chunks);
+    threads.emplace_back([=] { body(begin, end); });
+  }
+  body(0, int(int64_t(count) / chunks));
+  for (auto& thread : threads) thread.join();
+}
+
+// Replace each value by the sum of the values before it, and return the total:
+inline int parallel_prefix_sum(int* values, int count, int grain = 16384) {
+  int chunks = parallel_chunks(count, grain);
+  std::vector<int> sums(chunks + 1, 0);
+  auto chunk_begin = [&](int c) { return int(int64_t(count) * c / chunks); };
+  parallel_for(chunks, [&](int first, int last) { // Sum each chunk...
+    for (int c = first; c < last; c++) {
+      int sum = 0;
+      for (int i = chunk_begin(c); i < chunk_begin(c + 1); i++) sum += values[i];
+      sums[c + 1] = sum;
+    }
+  }, 1);
+  for (int c = 0; c < chunks; c++) sums[c + 1] += sums[c]; // Where each chunk starts.
+  parallel_for(chunks, [&](int first, int last) { // Then scan each chunk from its start.
+    for (int c = first; c < last; c++) {
+      int running = sums[c];
+      for (int i = chunk_begin(c); i < chunk_begin(c + 1); i++) {
+        int value = values[i];
+        values[i] = running;
+        running += value;
+      }
+    }
+  }, 1);
+  return sums[chunks];
+}
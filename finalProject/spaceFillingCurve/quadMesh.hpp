@@ -0,0 +1,423 @@
+// Quad Mesh:
+//
+// A quad mesh kept in flat, index based arrays instead of a vector of neighbors inside every
+// vertex, edge and face.
+//
+// - Faces store 4 vertex and 4 edge indices each, edges store 2 vertex and 2 face indices each,
+//   so a face's or an edge's neighbors are a fixed offset into one array.
+// - A vertex's edges and faces have varying counts, so they're stored compressed (CSR): one array
+//   of every vertex's neighbors back to back, and an array of where each vertex's run starts.
+// - The whole mesh is a dozen allocations whatever its size, and neighbors are found in O(1).
+//
+// Edge j of a face joins its corners j and j + 1. Faces keep the index of the face they were
+// split from, so the subdivision hierarchy can be walked back up.
+//
+// Subdivision finds shared vertices and edges from the topology, never by comparing positions:
+// the output vertices are laid out as [vertex points | edge points | face points], so the point
+// of input vertex v, edge e or face f has a known index, and child j of face f is face 4f + j.
+// Each level is linear in the size of the mesh and exact whatever the float rounding. Because
+// every output index is known in advance, each stage is a parallel loop with no locks, and the
+// result is the same on any number of threads.
+
+#pragma once
+
+#include "al/math/al_Vec.hpp" // For Vec3f.
+#include "parallelFor.hpp" // For subdividing on every core.
+#include <chrono> // For the benchmark.
+#include <cstdint> // For the edge keys.
+#include <cstdio> // For the benchmark's report.
+#include <unordered_map> // For finding the edges of a base mesh.
+#include <utility> // For std::move, std::swap.
+#include <vector> // For the arrays.
+
+struct quad_mesh {
+  // Vertices:
+  std::vector<al::Vec3f> positions; // Position of each vertex.
+  std::vector<int> vertex_edge_offsets; // Where each vertex's edges start in vertex_edges, one more than the vertices.
+  std::vector<int> vertex_edges; // Edges of every vertex, back to back.
+  std::vector<int> vertex_face_offsets; // Where each vertex's faces start in vertex_faces, one more than the vertices.
+  std::vector<int> vertex_faces; // Faces of every vertex, back to back.
+
+  // Edges:
+  std::vector<al::Vec3f> midpoints; // Midpoint of each edge.
+  std::vector<int> edge_vertices; // 2 per edge.
+  std::vector<int> edge_faces; // 2 per edge, -1 where an edge has only one face.
+
+  // Faces:
+  std::vector<al::Vec3f> centroids; // Centroid of each face.
+  std::vector<int> face_vertices; // 4 per face, in winding order.
+  std::vector<int> face_edges; // 4 per face, edge j joins corners j and j + 1.
+  std::vector<int> face_parents; // The face of the coarser mesh each face was split from, -1 for a base mesh.
+
+  int vertex_count() const { return int(positions.size()); }
+  int edge_count() const { return int(midpoints.size()); }
+  int face_count() const { return int(centroids.size()); }
+
+  // The edges and faces around a vertex:
+  int edge_valence(int v) const { return vertex_edge_offsets[v + 1] - vertex_edge_offsets[v]; }
+  const int* edges_of(int v) const { return &vertex_edges[vertex_edge_offsets[v]]; }
+  int face_valence(int v) const { return vertex_face_offsets[v + 1] - vertex_face_offsets[v]; }
+  const int* faces_of(int v) const { return &vertex_faces[vertex_face_offsets[v]]; }
+
+  // Bytes held by the arrays:
+  size_t memory() const {
+    return (positions.capacity() + midpoints.capacity() + centroids.capacity()) * sizeof(al::Vec3f) +
+      (vertex_edge_offsets.capacity() + vertex_edges.capacity() + vertex_face_offsets.capacity() + vertex_faces.capacity() +
+       edge_vertices.capacity() + edge_faces.capacity() + face_vertices.capacity() + face_edges.capacity() + face_parents.capacity()) * sizeof(int);
+  }
+};
+
+// Average the corners of every face:
+inline void build_centroids(quad_mesh& mesh) {
+  int faces = int(mesh.face_vertices.size() / 4);
+  mesh.centroids.resize(faces);
+  parallel_for(faces, [&](int begin, int end) {
+    for (int f = begin; f < end; f++) {
+      const int* corner = &mesh.face_vertices[4 * f];
+      mesh.centroids[f] = (mesh.positions[corner[0]] + mesh.positions[corner[1]] + mesh.positions[corner[2]] + mesh.positions[corner[3]]) / 4.0f;
+    }
+  });
+}
+
+// Find the midpoint of every edge:
+inline void build_midpoints(quad_mesh& mesh) {
+  int edges = int(mesh.edge_vertices.size() / 2);
+  mesh.midpoints.resize(edges);
+  parallel_for(edges, [&](int begin, int end) {
+    for (int e = begin; e < end; e++) mesh.midpoints[e] = (mesh.positions[mesh.edge_vertices[2 * e]] + mesh.positions[mesh.edge_vertices[2 * e + 1]]) / 2.0f;
+  });
+}
+
+// Find the edges and faces around every vertex, counted then filled:
+inline void build_vertex_neighbors(quad_mesh& mesh) {
+  int vertices = mesh.vertex_count();
+  mesh.vertex_edge_offsets.assign(vertices + 1, 0);
+  mesh.vertex_face_offsets.assign(vertices + 1, 0);
+  for (int v : mesh.edge_vertices) mesh.vertex_edge_offsets[v + 1]++;
+  for (int v : mesh.face_vertices) mesh.vertex_face_offsets[v + 1]++;
+  for (int v = 0; v < vertices; v++) { // Running sums give where each vertex's run starts.
+    mesh.vertex_edge_offsets[v + 1] += mesh.vertex_edge_offsets[v];
+    mesh.vertex_face_offsets[v + 1] += mesh.vertex_face_offsets[v];
+  }
+  mesh.vertex_edges.resize(mesh.vertex_edge_offsets[vertices]);
+  mesh.vertex_faces.resize(mesh.vertex_face_offsets[vertices]);
+  std::vector<int> edge_fill(mesh.vertex_edge_offsets.begin(), mesh.vertex_edge_offsets.end() - 1);
+  std::vector<int> face_fill(mesh.vertex_face_offsets.begin(), mesh.vertex_face_offsets.end() - 1);
+  int edges = int(mesh.edge_vertices.size() / 2), faces = int(mesh.face_vertices.size() / 4);
+  for (int e = 0; e < edges; e++) {
+    for (int k = 0; k < 2; k++) mesh.vertex_edges[edge_fill[mesh.edge_vertices[2 * e + k]]++] = e;
+  }
+  for (int f = 0; f < faces; f++) {
+    for (int j = 0; j < 4; j++) mesh.vertex_faces[face_fill[mesh.face_vertices[4 * f + j]]++] = f;
+  }
+}
+
+// Which corner of a face a vertex is:
+inline int corner_slot(const quad_mesh& mesh, int f, int v) {
+  const int* corner = &mesh.face_vertices[4 * f];
+  return corner[0] == v ? 0 : corner[1] == v ? 1 : corner[2] == v ? 2 : 3;
+}
+
+// Find the edges and faces around every vertex of a subdivided mesh from its parent. Each new
+// vertex's counts are known from the parent, a prefix sum turns them into offsets, and then every
+// vertex fills its own run, all in parallel and in the same order every time:
+inline void build_child_neighbors(const quad_mesh& input, quad_mesh& output) {
+  int vertices = input.vertex_count(), edges = input.edge_count();
+  int edge_base = vertices, face_base = vertices + edges, inner_base = 2 * edges;
+  int count = output.vertex_count();
+  output.vertex_edge_offsets.resize(count + 1);
+  output.vertex_face_offsets.resize(count + 1);
+  parallel_for(count, [&](int begin, int end) { // Count...
+    for (int v = begin; v < end; v++) {
+      if (v < edge_base) { // A vertex point keeps its vertex's neighbors.
+        output.vertex_edge_offsets[v] = input.edge_valence(v);
+        output.vertex_face_offsets[v] = input.face_valence(v);
+      } else if (v < face_base) { // An edge point has both halves of its edge, and a face and an inner edge per side.
+        int e = v - edge_base, sides = (input.edge_faces[2 * e] >= 0) + (input.edge_faces[2 * e + 1] >= 0);
+        output.vertex_edge_offsets[v] = 2 + sides;
+        output.vertex_face_offsets[v] = 2 * sides;
+      } else { // A face point has its face's four inner edges and four children.
+        output.vertex_edge_offsets[v] = 4;
+        output.vertex_face_offsets[v] = 4;
+      }
+    }
+  });
+  output.vertex_edge_offsets[count] = output.vertex_face_offsets[count] = 0;
+  output.vertex_edges.resize(parallel_prefix_sum(output.vertex_edge_offsets.data(), count + 1)); // Offsets, the last one is the total.
+  output.vertex_faces.resize(parallel_prefix_sum(output.vertex_face_offsets.data(), count + 1));
+  parallel_for(count, [&](int begin, int end) { // ...then fill.
+    for (int v = begin; v < end; v++) {
+      int* out_edges = &output.vertex_edges[output.vertex_edge_offsets[v]];
+      int* out_faces = &output.vertex_faces[output.vertex_face_offsets[v]];
+      if (v < edge_base) {
+        const int* in_edges = input.edges_of(v);
+        for (int j = 0; j < input.edge_valence(v); j++) {
+          int e = in_edges[j];
+          out_edges[j] = 2 * e + (input.edge_vertices[2 * e] == v ? 0 : 1); // The half at this vertex.
+        }
+        const int* in_faces = input.faces_of(v);
+        for (int j = 0; j < input.face_valence(v); j++) {
+          out_faces[j] = 4 * in_faces[j] + corner_slot(input, in_faces[j], v); // The child at this vertex.
+        }
+      } else if (v < face_base) {
+        int e = v - edge_base;
+        *out_edges++ = 2 * e;
+        *out_edges++ = 2 * e + 1;
+        for (int k = 0; k < 2; k++) {
+          int f = input.edge_faces[2 * e + k];
+          if (f < 0) continue;
+          int slot = 0;
+          while (input.face_edges[4 * f + slot] != e) slot++;
+          *out_edges++ = inner_base + 4 * f + slot;
+          *out_faces++ = 4 * f + slot; // The children at the edge's two corners.
+          *out_faces++ = 4 * f + (slot + 1) % 4;
+        }
+      } else {
+        int f = v - face_base;
+        for (int j = 0; j < 4; j++) {
+          out_edges[j] = inner_base + 4 * f + j;
+          out_faces[j] = 4 * f + j;
+        }
+      }
+    }
+  });
+}
+
+// Record a face on one side of an edge:
+inline void add_edge_face(quad_mesh& mesh, int e, int f) {
+  if (mesh.edge_faces[2 * e] < 0) mesh.edge_faces[2 * e] = f;
+  else mesh.edge_faces[2 * e + 1] = f;
+}
+
+// Find the edges, centroids and vertex neighbors of a base mesh from its positions and face_vertices.
+// Edges are matched by the pair of vertices they join:
+inline void build_adjacency(quad_mesh& mesh) {
+  int faces = int(mesh.face_vertices.size() / 4);
+  build_centroids(mesh);
+  if (mesh.face_parents.size() != size_t(faces)) mesh.face_parents.assign(faces, -1);
+  mesh.edge_vertices.clear();
+  mesh.edge_faces.clear();
+  mesh.face_edges.assign(4 * faces, -1);
+  std::unordered_map<uint64_t, int> edge_index; // From the pair of vertices, lowest first.
+  edge_index.reserve(2 * faces);
+  for (int f = 0; f < faces; f++) { // For each face...
+    for (int j = 0; j < 4; j++) { // For each edge of the face...
+      uint32_t a = mesh.face_vertices[4 * f + j], b = mesh.face_vertices[4 * f + (j + 1) % 4];
+      uint64_t key = a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+      auto found = edge_index.emplace(key, int(mesh.edge_vertices.size() / 2));
+      int e = found.first->second;
+      if (found.second) { // A new edge.
+        mesh.edge_vertices.push_back(int(a));
+        mesh.edge_vertices.push_back(int(b));
+        mesh.edge_faces.push_back(-1);
+        mesh.edge_faces.push_back(-1);
+      }
+      add_edge_face(mesh, e, f);
+      mesh.face_edges[4 * f + j] = e;
+    }
+  }
+  build_midpoints(mesh);
+  build_vertex_neighbors(mesh);
+}
+
+// Create a cube with quad faces:
+inline quad_mesh create_cube(float size) {
+  quad_mesh cube;
+
+  // The vertices of a cube:
+  cube.positions = {
+    al::Vec3f(size * -1.0f, size * -1.0f, size * 1.0f), // Vertex 0
+    al::Vec3f(size * 1.0f, size * -1.0f, size * 1.0f), // Vertex 1
+    al::Vec3f(size * -1.0f, size * 1.0f, size * 1.0f), // Vertex 2
+    al::Vec3f(size * 1.0f, size * 1.0f, size * 1.0f), // Vertex 3
+    al::Vec3f(size * -1.0f, size * -1.0f, size * -1.0f), // Vertex 4
+    al::Vec3f(size * 1.0f, size * -1.0f, size * -1.0f), // Vertex 5
+    al::Vec3f(size * -1.0f, size * 1.0f, size * -1.0f), // Vertex 6
+    al::Vec3f(size * 1.0f, size * 1.0f, size * -1.0f) // Vertex 7
+  };
+
+  // The indices of the vertices for each face:
+  cube.face_vertices = {
+    0, 1, 3, 2, // Face 0
+    3, 1, 5, 7, // Face 1
+    3, 7, 6, 2, // Face 2
+    6, 4, 0, 2, // Face 3
+    6, 7, 5, 4, // Face 4
+    5, 1, 0, 4 // Face 5
+  };
+
+  build_adjacency(cube); // Edges, centroids and vertex neighbors.
+  return cube;
+}
+
+// Reserve room in a mesh for a base mesh subdivided some levels. Each level has V + E + F
+// vertices, 2E + 4F edges and 4F faces of the level before:
+inline void reserve_levels(quad_mesh& mesh, const quad_mesh& base, int levels) {
+  size_t vertices = base.vertex_count(), edges = base.edge_count(), faces = base.face_count();
+  for (int level = 0; level < levels; level++) {
+    size_t next_vertices = vertices + edges + faces, next_edges = 2 * edges + 4 * faces;
+    faces *= 4;
+    vertices = next_vertices;
+    edges = next_edges;
+  }
+  mesh.positions.reserve(vertices);
+  mesh.vertex_edge_offsets.reserve(vertices + 1);
+  mesh.vertex_edges.reserve(2 * edges);
+  mesh.vertex_face_offsets.reserve(vertices + 1);
+  mesh.vertex_faces.reserve(4 * faces);
+  mesh.midpoints.reserve(edges);
+  mesh.edge_vertices.reserve(2 * edges);
+  mesh.edge_faces.reserve(2 * edges);
+  mesh.centroids.reserve(faces);
+  mesh.face_vertices.reserve(4 * faces);
+  mesh.face_edges.reserve(4 * faces);
+  mesh.face_parents.reserve(faces);
+}
+
+// Apply one level of Catmull-Clark subdivision, splitting each face into four. The output's arrays
+// are resized, not reallocated, when they have room, so two meshes can be reused level after
+// level. Every stage is a parallel loop over one of the input's arrays, writing to output indices
+// known in advance:
+inline void catmull_clark(const quad_mesh& input, quad_mesh& output) {
+  int vertices = input.vertex_count(), edges = input.edge_count(), faces = input.face_count();
+  int edge_base = vertices, face_base = vertices + edges; // The new vertices: every vertex point, then every edge point, then every face point.
+  int inner_base = 2 * edges; // The new edges: two halves of every edge, then four inside every face.
+  output.positions.resize(vertices + edges + faces);
+  output.edge_vertices.resize(2 * (2 * edges + 4 * faces));
+  output.edge_faces.resize(2 * (2 * edges + 4 * faces));
+  output.face_vertices.resize(16 * faces);
+  output.face_edges.resize(16 * faces);
+  output.face_parents.resize(4 * faces);
+
+  // Each face point is the face's centroid. Each face adds an edge from each of its edge points to
+  // its face point, shared by the children on either side of it:
+  std::copy(input.centroids.begin(), input.centroids.end(), output.positions.begin() + face_base);
+  parallel_for(faces, [&](int begin, int end) {
+    for (int f = begin; f < end; f++) {
+      for (int j = 0; j < 4; j++) {
+        int inner = inner_base + 4 * f + j;
+        output.edge_vertices[2 * inner] = edge_base + input.face_edges[4 * f + j];
+        output.edge_vertices[2 * inner + 1] = face_base + f;
+        output.edge_faces[2 * inner] = 4 * f + j; // The child at the edge's first corner...
+        output.edge_faces[2 * inner + 1] = 4 * f + (j + 1) % 4; // ...and at its second.
+      }
+    }
+  });
+
+  // Each edge point is the average of the edge's two vertices and its neighboring face centroids.
+  // Edge e splits into edge 2e, on the side of its first vertex, and edge 2e + 1:
+  parallel_for(edges, [&](int begin, int end) {
+    for (int e = begin; e < end; e++) { // For each edge in the input mesh...
+      int a = input.edge_vertices[2 * e], b = input.edge_vertices[2 * e + 1];
+      al::Vec3f sum = input.positions[a] + input.positions[b];
+      float count = 2.0f;
+      for (int k = 0; k < 2; k++) {
+        int f = input.edge_faces[2 * e + k];
+        if (f >= 0) {
+          sum += input.centroids[f];
+          count += 1.0f;
+        }
+      }
+      output.positions[edge_base + e] = sum / count;
+      int* halves = &output.edge_vertices[4 * e];
+      halves[0] = a;
+      halves[1] = edge_base + e;
+      halves[2] = edge_base + e;
+      halves[3] = b;
+      for (int k = 0; k < 2; k++) { // Each half borders the children at its vertex, in the faces on either side.
+        int f = input.edge_faces[2 * e + k];
+        output.edge_faces[2 * (2 * e) + k] = f >= 0 ? 4 * f + corner_slot(input, f, a) : -1;
+        output.edge_faces[2 * (2 * e + 1) + k] = f >= 0 ? 4 * f + corner_slot(input, f, b) : -1;
+      }
+    }
+  });
+
+  // Each vertex moves to the barycenter of its face centroids, edge midpoints and original position,
+  // with weights 1, 2 and (n - 3):
+  parallel_for(vertices, [&](int begin, int end) {
+    for (int v = begin; v < end; v++) { // For each vertex in the input mesh...
+      al::Vec3f edge_sum = 0.0f, face_sum = 0.0f;
+      int n = input.edge_valence(v);
+      const int* vertex_edges = input.edges_of(v);
+      for (int j = 0; j < n; j++) edge_sum += input.midpoints[vertex_edges[j]];
+      const int* vertex_faces = input.faces_of(v);
+      for (int j = 0; j < input.face_valence(v); j++) face_sum += input.centroids[vertex_faces[j]];
+      al::Vec3f edge_avg = edge_sum / float(n);
+      al::Vec3f face_avg = face_sum / float(input.face_valence(v));
+      output.positions[v] = (face_avg + 2.0f * edge_avg + (float(n) - 3.0f) * input.positions[v]) / float(n);
+    }
+  });
+
+  // Each corner of a face becomes a face: the corner, the edge point after it, the face point and
+  // the edge point before it. Child j of face f is face 4f + j:
+  parallel_for(faces, [&](int begin, int end) {
+    for (int f = begin; f < end; f++) { // For each face in the input mesh...
+      for (int j = 0; j < 4; j++) { // For each corner of the face...
+        int child = 4 * f + j;
+        int corner = input.face_vertices[4 * f + j];
+        int after = input.face_edges[4 * f + j], before = input.face_edges[4 * f + (j + 3) % 4];
+        int* v = &output.face_vertices[4 * child];
+        v[0] = corner;
+        v[1] = edge_base + after;
+        v[2] = face_base + f;
+        v[3] = edge_base + before;
+        int* e = &output.face_edges[4 * child];
+        e[0] = 2 * after + (input.edge_vertices[2 * after] == corner ? 0 : 1); // The half of the edge on the corner's side.
+        e[1] = inner_base + 4 * f + j;
+        e[2] = inner_base + 4 * f + (j + 3) % 4;
+        e[3] = 2 * before + (input.edge_vertices[2 * before] == corner ? 0 : 1);
+        output.face_parents[child] = f;
+      }
+    }
+  });
+
+  build_centroids(output);
+  build_midpoints(output);
+  build_child_neighbors(input, output);
+}
+
+// Apply one level of Catmull-Clark subdivision into a new mesh:
+inline quad_mesh catmull_clark(const quad_mesh& input) {
+  quad_mesh output;
+  catmull_clark(input, output);
+  return output;
+}
+
+// Subdivide a mesh to a level, ping-ponging between two meshes allocated once at the final level's
+// size, so memory peaks at about twice the final level. Pass the base with std::move to reuse it:
+inline quad_mesh subdivide(quad_mesh base, int levels) {
+  quad_mesh other;
+  reserve_levels(other, base, levels);
+  reserve_levels(base, base, levels); // Grows the base's arrays once, before it's overwritten.
+  quad_mesh* current = &base;
+  quad_mesh* next = &other;
+  for (int level = 0; level < levels; level++) {
+    catmull_clark(*current, *next);
+    std::swap(current, next);
+  }
+  return std::move(*current);
+}
+
+// Subdivide the cube level by level, printing the time and memory of each level. Stops early
+// when a level takes longer than a time limit:
+inline void benchmark_subdivision(int max_level = 8, double time_limit = 2.0) {
+  printf("subdividing on %d threads\n", parallel_chunks(1 << 30, 1));
+  quad_mesh mesh = create_cube(1.0f), next;
+  for (int level = 1; level <= max_level; level++) {
+    auto start = std::chrono::steady_clock::now();
+    catmull_clark(mesh, next);
+    std::swap(mesh, next); // Moves, no copy.
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("level %d: %d faces, %d vertices, %d edges in %.2f ms, %.2f MB\n",
+      level, mesh.face_count(), mesh.vertex_count(), mesh.edge_count(), seconds * 1e3, mesh.memory() / 1048576.0);
+    if (seconds > time_limit && level < max_level) {
+      printf("stopping, level %d took over %.0f seconds\n", level, time_limit);
+      return;
+    }
+  }
+  auto start = std::chrono::steady_clock::now();
+  quad_mesh final_level = subdivide(create_cube(1.0f), max_level); // Straight to the last level.
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("subdivide to level %d: %.2f ms, %.2f MB, peak about %.2f MB\n",
+    max_level, seconds * 1e3, final_level.memory() / 1048576.0, 2.0 * final_level.memory() / 1048576.0);
+}
@@ -0,0 +1,152 @@
+// Ribbon:
+//
+// Turns a curve's points into a constant width ribbon, a triangle strip with two vertices per
+// point, built once so drawing it over time only moves how much of the strip is shown (task 6).
+//
+// - The ribbon's frame at each point is rotation minimizing (parallel transported): each point's
+//   normal is the one before it turned by the smallest rotation taking the previous tangent to this
+//   one, so the ribbon doesn't twist more than the curve makes it.
+// - Transport is a running product along the curve, so it's split like a prefix sum: each chunk
+//   of points transports two perpendicular vectors from its start in parallel, the chunks' start
+//   normals follow from those serially, then each chunk transports its own normals in parallel.
+// - On a closed curve the normal transported all the way round comes back turned. That angle is
+//   spread evenly along the curve, so the strip joins itself without a seam.
+//
+// Everything is written into arrays sized once, which are kept between builds.
+
+#pragma once
+
+#include "al/math/al_Vec.hpp" // For Vec3f.
+#include "parallelFor.hpp" // For building the frames on every core.
+#include <algorithm> // For std::min, std::max.
+#include <cmath> // For std::atan2, std::cos, std::sin, std::abs.
+#include <cstdint> // For int64_t.
+#include <vector> // For the strip.
+
+struct ribbon_strip {
+  std::vector<al::Vec3f> tangents, normals, binormals; // The frame at each point of the curve.
+  std::vector<al::Vec3f> positions; // Two vertices per point, either side of it along its binormal.
+  std::vector<al::Vec3f> vertex_normals; // The normal of each vertex, for lighting.
+  bool closed = false;
+
+  int points() const { return int(tangents.size()); }
+  int vertices() const { return int(positions.size()); }
+
+  // Strip vertices that show the first points of the curve, for drawing part of it:
+  int vertices_through(float shown_points) const {
+    return std::max(0, std::min(vertices(), 2 * int(shown_points)));
+  }
+};
+
+// Turn a vector by the smallest rotation taking unit vector from to unit vector to:
+inline al::Vec3f transport(const al::Vec3f& v, const al::Vec3f& from, const al::Vec3f& to) {
+  float d = from.dot(to);
+  if (d < -0.9999f) return -v; // Turning back on itself, any axis, keep the ribbon's side.
+  al::Vec3f c = cross(from, to);
+  return v * d + cross(c, v) + c * (c.dot(v) / (1.0f + d)); // Rodrigues' formula, without the trigonometry.
+}
+
+// A unit vector perpendicular to a unit tangent, as close to a hint as possible:
+inline al::Vec3f perpendicular(const al::Vec3f& tangent, const al::Vec3f& hint) {
+  al::Vec3f v = hint - tangent * tangent.dot(hint);
+  if (v.mag() < 1e-6f) v = std::abs(tangent[0]) < 0.9f ? cross(tangent, al::Vec3f(1, 0, 0)) : cross(tangent, al::Vec3f(0, 1, 0));
+  return v.normalize();
+}
+
+// Build a ribbon of some width along a curve's points. up is the first point's normal, projected
+// off its tangent, for a curve on a sphere its position gives a ribbon lying along the surface:
+inline void build_ribbon(const al::Vec3f* curve, int count, bool closed, float width, const al::Vec3f& up, ribbon_strip& ribbon) {
+  ribbon.closed = closed;
+  ribbon.tangents.resize(count);
+  ribbon.normals.resize(count);
+  ribbon.binormals.resize(count);
+  int strip = count > 1 ? 2 * (count + (closed ? 1 : 0)) : 0; // A closed strip repeats its first pair.
+  ribbon.positions.resize(strip);
+  ribbon.vertex_normals.resize(strip);
+  if (count < 2) return;
+
+  // Tangents, from the points either side, or the one beside at the ends of an open curve:
+  parallel_for(count, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      int before = i > 0 ? i - 1 : closed ? count - 1 : 0;
+      int after = i < count - 1 ? i + 1 : closed ? 0 : count - 1;
+      al::Vec3f t = curve[after] - curve[before];
+      ribbon.tangents[i] = t.mag() > 0.0f ? t.normalize() : al::Vec3f(0, 0, 1);
+    }
+  });
+  const al::Vec3f* tangents = ribbon.tangents.data();
+
+  // Transport two perpendicular vectors across each chunk, from any start:
+  int chunks = parallel_chunks(count, 4096);
+  auto chunk_begin = [&](int c) { return int(int64_t(count) * c / chunks); };
+  std::vector<al::Vec3f> start_u(chunks), start_w(chunks), end_u(chunks), end_w(chunks), start_normal(chunks);
+  parallel_for(chunks, [&](int first, int last) {
+    for (int c = first; c < last; c++) {
+      int begin = chunk_begin(c), end = chunk_begin(c + 1);
+      al::Vec3f u = perpendicular(tangents[begin], al::Vec3f(0, 1, 0)), w = cross(tangents[begin], u);
+      start_u[c] = u;
+      start_w[c] = w;
+      for (int i = begin + 1; i < end; i++) {
+        u = transport(u, tangents[i - 1], tangents[i]);
+        w = transport(w, tangents[i - 1], tangents[i]);
+      }
+      end_u[c] = u;
+      end_w[c] = w;
+    }
+  }, 1);
+
+  // Each chunk's start normal from the one before, through its pair of vectors:
+  start_normal[0] = perpendicular(tangents[0], up);
+  for (int c = 1; c < chunks; c++) {
+    const al::Vec3f& n = start_normal[c - 1];
+    al::Vec3f last = end_u[c - 1] * n.dot(start_u[c - 1]) + end_w[c - 1] * n.dot(start_w[c - 1]);
+    int i = chunk_begin(c);
+    start_normal[c] = perpendicular(tangents[i], transport(last, tangents[i - 1], tangents[i])); // Renormalized against drift.
+  }
+
+  // The normals, each chunk from its start:
+  parallel_for(chunks, [&](int first, int last) {
+    for (int c = first; c < last; c++) {
+      al::Vec3f n = start_normal[c];
+      for (int i = chunk_begin(c); i < chunk_begin(c + 1); i++) {
+        if (i > chunk_begin(c)) n = transport(n, tangents[i - 1], tangents[i]);
+        ribbon.normals[i] = n;
+      }
+    }
+  }, 1);
+
+  // Around a closed curve, the angle the normal comes back turned by, undone evenly:
+  float twist = 0.0f;
+  if (closed) {
+    al::Vec3f back = transport(ribbon.normals[count - 1], tangents[count - 1], tangents[0]);
+    twist = std::atan2(cross(back, ribbon.normals[0]).dot(tangents[0]), back.dot(ribbon.normals[0]));
+  }
+
+  // The strip, two vertices either side of each point:
+  float half = 0.5f * width;
+  parallel_for(count, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      al::Vec3f n = ribbon.normals[i], t = tangents[i];
+      if (twist != 0.0f) {
+        float angle = twist * i / count;
+        n = (n * std::cos(angle) + cross(t, n) * std::sin(angle)).normalize();
+        ribbon.normals[i] = n;
+      }
+      al::Vec3f b = cross(t, n);
+      ribbon.binormals[i] = b;
+      ribbon.positions[2 * i] = curve[i] - b * half;
+      ribbon.positions[2 * i + 1] = curve[i] + b * half;
+      ribbon.vertex_normals[2 * i] = ribbon.vertex_normals[2 * i + 1] = n;
+    }
+  });
+  if (closed) { // Back to the start.
+    for (int k = 0; k < 2; k++) {
+      ribbon.positions[2 * count + k] = ribbon.positions[k];
+      ribbon.vertex_normals[2 * count + k] = ribbon.vertex_normals[k];
+    }
+  }
+}
+
+inline void build_ribbon(const std::vector<al::Vec3f>& curve, bool closed, float width, const al::Vec3f& up, ribbon_strip& ribbon) {
+  build_ribbon(curve.data(), int(curve.size()), closed, width, up, ribbon);
+}
@@ -42,6 +42,8 @@
 #include "al/graphics/al_Isosurface.hpp" // Isosurface library.
 #include "al_ext/statedistribution/al_CuttleboneDomain.hpp" // For distributing state across multiple machines in AlloSphere.
 #include "al_ext/statedistribution/al_CuttleboneStateSimulationDomain.hpp"
+#include "al/graphics/al_VAOMesh.hpp" // For the ribbon, uploaded once and drawn in part.
+#include "ribbon.hpp" // The ribbon's frames and strip.
 #include <queue> // Priority queue library.
 
 // Namespaces:
@@ -71,7 +73,9 @@ struct face {
 
 // Main App Class:
 struct RayApp : public DistributedAppWithState<State> {
-  Mesh oldMesh, oldVertices, newMesh, newVertices, combinedMesh, combinedVertices, curveControl, curve1, curve2, ribbon; // The original mesh, the subdivided mesh, and the final curve to be displayed.
+  Mesh oldMesh, oldVertices, newMesh, newVertices, combinedMesh, combinedVertices, curveControl, curve1; // The original mesh, the subdivided mesh, and the initial curve.
+  ribbon_strip ribbonStrip; // The ribbon's frames and vertices, built once.
+  VAOMesh ribbon; // The final curve to be displayed, uploaded once.
   
   void onCreate() override {
     auto cuttleboneDomain =
@@ -193,20 +197,20 @@ struct RayApp : public DistributedAppWithState<State> {
     });
     
     // 6. Use the curve to generate the path for a constant diameter ribbon:
-    // 6A. Calculate tangent vector
-    curve2.primitive(Mesh::LINES);
-    for (int i = 0; i < curve1.vertices().size(); i++){
-      Vec3f tangent = (curve1.vertices()[i + 1] - curve1.vertices()[i]).normalize(); // Calculate the tangent vector.
-      Vec3f normal = (curve1.vertices()[i] - Vec3f(0, 0, 0)).normalize(); // Set the normal vector to be the y-axis.
-      Vec3f binormal = cross(tangent, normal); // Calculate the binormal vector.
-      Vec3f v = curve1.vertices()[i] + binormal * 0.005; // Calculate the position of the ribbon.
-      curve2.vertex(v); // Assign the position to the ribbon.
-      curve2.color(HSV(1.0, 0.0, 1.0)); // Set the color of the ribbon.
-      travel++; // Increment the travel index.
+    vector<Vec3f> path; // The curve's points in the order it visits them.
+    path.push_back(curve1.vertices()[curve1.indices()[0]]);
+    for (int i = 1; i < curve1.indices().size(); i += 2) { // The second end of each line is the next point.
+      path.push_back(curve1.vertices()[curve1.indices()[i]]);
     }
-    
-
-    ribbon.primitive(Mesh::TRIANGLE_STRIP); // Set the primitive type of the curve to be lines.
+    // 6A-6C. Tangent, normal and binormal of every point, rotation minimizing, with the normal starting out of the sphere:
+    build_ribbon(path, false, 0.01f, path[0], ribbonStrip);
+    ribbon.primitive(Mesh::TRIANGLE_STRIP); // Set the primitive type of the ribbon to be a triangle strip.
+    for (int i = 0; i < ribbonStrip.vertices(); i++) {
+      ribbon.vertex(ribbonStrip.positions[i]);
+      ribbon.normal(ribbonStrip.vertex_normals[i]);
+      ribbon.color(HSV(float(i / 2) / float(ribbonStrip.points()), 0.5, 1.0)); // Set the color of the ribbon to be a gradient.
+    }
+    ribbon.update(); // Upload the whole ribbon once, animating only changes how much of it is drawn.
     travel = 0;
   }
 
@@ -221,14 +225,7 @@ struct RayApp : public DistributedAppWithState<State> {
     // if(timer < 1.0f){
     //   Vec3f curve1Pos = lerp(curve1.vertices()[travel], curve1.vertices()[travel + 1], timer); // Linearly interpolate between the vertices of the initial curve over time.
     //   Vec3f curve2Pos = lerp(curve2.vertices()[travel], curve2.vertices()[travel + 1], timer); // Linearly interpolate between the vertices of the initial curve over time.
-    if (travel < curve1.indices().size()){
-      Vec3f curve1Pos = curve1.vertices()[travel]; // Assign the interpolated position to the curve.
-      Vec3f curve2Pos = curve2.vertices()[travel]; // Assign the interpolated position to the curve.
-      ribbon.vertex(curve1Pos); // Assign the interpolated position to the curve.
-      ribbon.vertex(curve2Pos); // Assign the interpolated position to the curve.
-      ribbon.color(HSV(float(travel) / float(curve1.vertices().size()), 0.5, 1.0)); // Set the color of the curve to be a gradient.
-      ribbon.color(HSV(float(travel) / float(curve2.vertices().size()), 0.5, 1.0)); // Set the color of the curve to be a gradient.
-      ribbon.smooth(1.0f, 1);
+    if (travel < ribbonStrip.points()){ // Show one more point of the ribbon each frame.
       travel++;
     }
     // }
@@ -262,7 +259,12 @@ struct RayApp : public DistributedAppWithState<State> {
     g.draw(curveControl); // Draw the curve control points.
     g.draw(curve1); // Draw the initial curve.
     g.polygonMode(true ? GL_FILL : GL_FILL); // Make the mesh solid.      
-    g.draw(ribbon); // Draw the final curve.
+    int shown = ribbonStrip.vertices_through(travel); // Draw the final curve as far as it has traveled.
+    if (shown > 2) {
+      g.update(); // Send the matrices and color mode to the shader before drawing by hand.
+      ribbon.vao().bind();
+      glDrawArrays(GL_TRIANGLE_STRIP, 0, shown);
+    }
   }
 };
 
@@ -0,0 +1,187 @@
+// Spline:
+//
+// A smooth curve through (Catmull-Rom) or near (cubic B-spline) a curve's points, so the ribbon
+// bends smoothly from face to face instead of turning at every centroid.
+//
+// - Each segment is stored as the coefficients of its cubic, p(t) = a + t (b + t (c + t d)), in
+//   one flat array, so evaluating a point is a lookup and three multiply-adds per coordinate, and a
+//   batch of points is a loop over the array with no branches, split across threads.
+// - Arc length is tabulated once, a running sum of short chords, so a distance along the curve
+//   turns into a parameter by binary search. Drawing at constant speed is then a distance per
+//   second, whatever the lengths of the segments.
+// - Tessellation is adaptive: each segment gets as many samples as its turning needs, counted in
+//   parallel, turned into offsets with a prefix sum and filled in parallel, so straight runs cost
+//   one vertex and tight turns as many as they need.
+//
+// The parameter u runs from 0 to the number of segments, segment i from u = i to u = i + 1.
+
+#pragma once
+
+#include "al/math/al_Vec.hpp" // For Vec3f.
+#include "parallelFor.hpp" // For batches on every core.
+#include <algorithm> // For std::min, std::max, std::upper_bound.
+#include <cmath> // For std::acos, std::ceil.
+#include <vector> // For the coefficients and tables.
+
+enum class spline_kind { catmull_rom, b_spline };
+
+struct curve_spline {
+  spline_kind kind = spline_kind::catmull_rom;
+  bool closed = false;
+  int table_steps = 16; // Arc length table entries per segment.
+  std::vector<float> coefficients; // 12 per segment: a, b, c, d, each x, y, z.
+  std::vector<float> lengths; // Arc length at each table entry, table_steps per segment plus the end.
+
+  int segments() const { return int(coefficients.size() / 12); }
+  float length() const { return lengths.empty() ? 0.0f : lengths.back(); }
+
+  // Fit the spline to points, and tabulate its length:
+  void setup(const al::Vec3f* points, int count, bool closed_curve, spline_kind spline = spline_kind::catmull_rom) {
+    kind = spline;
+    closed = closed_curve;
+    int count_segments = count < 2 ? 0 : closed ? count : count - 1;
+    coefficients.resize(12 * count_segments);
+    auto point = [&](int i) -> const al::Vec3f& { // Wrapped around a closed curve, clamped to the ends of an open one.
+      return points[closed ? (i % count + count) % count : std::min(std::max(i, 0), count - 1)];
+    };
+    parallel_for(count_segments, [&](int begin, int end) {
+      for (int s = begin; s < end; s++) {
+        const al::Vec3f &p0 = point(s - 1), &p1 = point(s), &p2 = point(s + 1), &p3 = point(s + 2);
+        al::Vec3f a, b, c, d;
+        if (kind == spline_kind::catmull_rom) { // Through p1 and p2, with tangents from their neighbors.
+          a = p1;
+          b = (p2 - p0) * 0.5f;
+          c = p0 - p1 * 2.5f + p2 * 2.0f - p3 * 0.5f;
+          d = (p3 - p0) * 0.5f + (p1 - p2) * 1.5f;
+        } else { // Near the points, with a continuous curvature.
+          a = (p0 + p1 * 4.0f + p2) / 6.0f;
+          b = (p2 - p0) * 0.5f;
+          c = (p0 + p2) * 0.5f - p1;
+          d = (p3 - p0) / 6.0f + (p1 - p2) * 0.5f;
+        }
+        float* k = &coefficients[12 * s];
+        for (int j = 0; j < 3; j++) {
+          k[j] = a[j];
+          k[3 + j] = b[j];
+          k[6 + j] = c[j];
+          k[9 + j] = d[j];
+        }
+      }
+    });
+    build_lengths();
+  }
+
+  void setup(const std::vector<al::Vec3f>& points, bool closed_curve, spline_kind spline = spline_kind::catmull_rom) {
+    setup(points.data(), int(points.size()), closed_curve, spline);
+  }
+
+  // The position and tangent at a parameter:
+  al::Vec3f position(float u) const {
+    int s;
+    float t = locate(u, s);
+    const float* k = &coefficients[12 * s];
+    return al::Vec3f(k[0] + t * (k[3] + t * (k[6] + t * k[9])), k[1] + t * (k[4] + t * (k[7] + t * k[10])), k[2] + t * (k[5] + t * (k[8] + t * k[11])));
+  }
+  al::Vec3f tangent(float u) const {
+    int s;
+    float t = locate(u, s);
+    const float* k = &coefficients[12 * s];
+    return al::Vec3f(k[3] + t * (2.0f * k[6] + t * 3.0f * k[9]), k[4] + t * (2.0f * k[7] + t * 3.0f * k[10]), k[5] + t * (2.0f * k[8] + t * 3.0f * k[11]));
+  }
+
+  // Evaluate a batch of parameters at once:
+  void evaluate(const float* u, int count, al::Vec3f* out) const {
+    parallel_for(count, [&](int begin, int end) {
+      for (int i = begin; i < end; i++) out[i] = position(u[i]);
+    });
+  }
+
+  // The parameter a distance along the curve, by binary search in the length table:
+  float parameter_at(float distance) const {
+    if (lengths.size() < 2) return 0.0f;
+    distance = std::min(std::max(distance, 0.0f), length());
+    int i = int(std::upper_bound(lengths.begin() + 1, lengths.end() - 1, distance) - lengths.begin()) - 1; // The entry at or before it.
+    float span = lengths[i + 1] - lengths[i];
+    float fraction = span > 0.0f ? (distance - lengths[i]) / span : 0.0f;
+    return (i + fraction) / table_steps;
+  }
+
+  // Points equally spaced along the curve, for drawing at constant speed:
+  void sample_evenly(int count, std::vector<al::Vec3f>& out) const {
+    out.resize(count);
+    float spacing = count > 1 ? length() / (closed ? count : count - 1) : 0.0f;
+    parallel_for(count, [&](int begin, int end) {
+      for (int i = begin; i < end; i++) out[i] = position(parameter_at(i * spacing));
+    });
+  }
+
+  // Points spaced by curvature: each segment is split until each piece turns less than an angle, in
+  // radians, with at most max_steps pieces. parameters receives each point's parameter:
+  void tessellate(float max_angle, std::vector<al::Vec3f>& out, std::vector<float>& parameters, int max_steps = 32) const {
+    int count_segments = segments();
+    std::vector<int> offsets(count_segments + 1);
+    parallel_for(count_segments, [&](int begin, int end) { // Count...
+      for (int s = begin; s < end; s++) {
+        float turning = 0.0f; // The angle the tangent turns through, over a few steps.
+        al::Vec3f previous = tangent(float(s));
+        for (int j = 1; j <= 4; j++) {
+          al::Vec3f next = tangent(s + j * 0.25f);
+          float magnitudes = previous.mag() * next.mag();
+          if (magnitudes > 0.0f) turning += std::acos(std::min(std::max(previous.dot(next) / magnitudes, -1.0f), 1.0f)); // Skips a cusp's zero tangent.
+          previous = next;
+        }
+        offsets[s] = std::min(std::max(int(std::ceil(turning / max_angle)), 1), max_steps);
+      }
+    });
+    offsets[count_segments] = 0;
+    int total = parallel_prefix_sum(offsets.data(), count_segments + 1);
+    int end_point = closed || count_segments == 0 ? 0 : 1; // An open curve also keeps its last point.
+    out.resize(total + end_point);
+    parameters.resize(total + end_point);
+    parallel_for(count_segments, [&](int begin, int end) { // ...then fill.
+      for (int s = begin; s < end; s++) {
+        int steps = offsets[s + 1] - offsets[s];
+        for (int j = 0; j < steps; j++) {
+          float u = s + float(j) / steps;
+          parameters[offsets[s] + j] = u;
+          out[offsets[s] + j] = position(u);
+        }
+      }
+    });
+    if (end_point) {
+      parameters[total] = float(count_segments);
+      out[total] = position(float(count_segments));
+    }
+  }
+
+private:
+  // The segment of a parameter and the parameter within it, clamped to the curve:
+  float locate(float u, int& s) const {
+    int last = segments() - 1;
+    s = std::min(std::max(int(u), 0), last);
+    return std::min(std::max(u - s, 0.0f), 1.0f);
+  }
+
+  // Sum short chords into the arc length table, each segment's in parallel, then the segments':
+  void build_lengths() {
+    int count_segments = segments();
+    lengths.resize(count_segments * table_steps + 1);
+    lengths[0] = 0.0f;
+    parallel_for(count_segments, [&](int begin, int end) {
+      for (int s = begin; s < end; s++) {
+        al::Vec3f previous = position(float(s));
+        float sum = 0.0f;
+        for (int j = 1; j <= table_steps; j++) { // Lengths within the segment.
+          al::Vec3f next = position(s + float(j) / table_steps);
+          sum += (next - previous).mag();
+          lengths[s * table_steps + j] = sum;
+          previous = next;
+        }
+      }
+    });
+    for (int s = 1; s < count_segments; s++) { // Then offset by the segments before.
+      float before = lengths[s * table_steps];
+      for (int j = 1; j <= table_steps; j++) lengths[s * table_steps + j] += before;
+    }
+  }
+};
@@ -0,0 +1,171 @@
+// Stencil Table:
+//
+// Records how every vertex of a subdivided mesh is weighted from the base mesh's vertices, so the
+// subdivided positions can be recomputed every frame as the base deforms, without subdividing again.
+//
+// - Catmull-Clark is linear in the positions: each new vertex is a fixed weighted sum of vertices
+//   of the level before, and so, level by level, of the base vertices. build() walks the topology
+//   once and composes those weights into one sparse row per refined vertex (CSR: offsets, control
+//   indices and weights).
+// - evaluate() is then one sparse matrix-vector product, a parallel loop over the rows with no
+//   branching and no allocation. The topology of the subdivided mesh doesn't change, only its
+//   positions, so it can be reused from the first subdivision.
+//
+// Rows follow the vertex order of catmull_clark(), so the result matches its positions.
+
+#pragma once
+
+#include "quadMesh.hpp" // For the topology of each level.
+#include "parallelFor.hpp" // For evaluating rows on every core.
+#include <algorithm> // For std::max.
+#include <chrono> // For the benchmark.
+#include <cmath> // For the benchmark's pulse.
+#include <cstdio> // For the benchmark's report.
+#include <vector> // For the table.
+
+struct stencil_table {
+  int controls = 0; // Number of base vertices.
+  std::vector<int> offsets; // Where each row starts, one more than the rows.
+  std::vector<int> indices; // Base vertex of each weight.
+  std::vector<float> weights;
+
+  int rows() const { return int(offsets.size()) - 1; }
+
+  // Compose the stencils of a base mesh subdivided some levels:
+  void build(const quad_mesh& base, int levels) {
+    controls = base.vertex_count();
+    offsets.resize(controls + 1);
+    indices.resize(controls);
+    weights.assign(controls, 1.0f);
+    for (int v = 0; v <= controls; v++) offsets[v] = v; // Level 0, every vertex is itself.
+    for (int v = 0; v < controls; v++) indices[v] = v;
+
+    quad_mesh current = base, next;
+    std::vector<float> accumulated(controls, 0.0f); // Weight of each control in the row being built.
+    std::vector<char> marked(controls, 0); // Whether each control is in the row yet.
+    std::vector<int> touched; // The controls with a weight in it.
+    std::vector<int> next_offsets, next_indices;
+    std::vector<float> next_weights;
+    for (int level = 0; level < levels; level++) {
+      int vertices = current.vertex_count(), edges = current.edge_count(), faces = current.face_count();
+      next_offsets.assign(1, 0);
+      next_indices.clear();
+      next_weights.clear();
+
+      // Add a vertex of this level with a weight, through its own row:
+      auto add = [&](int v, float w) {
+        if (w == 0.0f) return; // Valence 3 vertices don't weigh themselves.
+        for (int i = offsets[v]; i < offsets[v + 1]; i++) {
+          int c = indices[i];
+          if (!marked[c]) {
+            marked[c] = 1;
+            touched.push_back(c);
+          }
+          accumulated[c] += w * weights[i];
+        }
+      };
+      auto add_face = [&](int f, float w) { // A face's centroid.
+        for (int j = 0; j < 4; j++) add(current.face_vertices[4 * f + j], 0.25f * w);
+      };
+      auto end_row = [&]() {
+        for (int c : touched) {
+          next_indices.push_back(c);
+          next_weights.push_back(accumulated[c]);
+          accumulated[c] = 0.0f;
+          marked[c] = 0;
+        }
+        touched.clear();
+        next_offsets.push_back(int(next_indices.size()));
+      };
+
+      // Vertex points, (F + 2R + (n - 3) P) / n:
+      for (int v = 0; v < vertices; v++) {
+        int n = current.edge_valence(v), m = current.face_valence(v);
+        add(v, (n - 3.0f) / n);
+        const int* vertex_edges = current.edges_of(v);
+        for (int j = 0; j < n; j++) { // Each edge's midpoint, 2 / n over n edges.
+          add(current.edge_vertices[2 * vertex_edges[j]], 1.0f / (n * n));
+          add(current.edge_vertices[2 * vertex_edges[j] + 1], 1.0f / (n * n));
+        }
+        const int* vertex_faces = current.faces_of(v);
+        for (int j = 0; j < m; j++) add_face(vertex_faces[j], 1.0f / (n * m)); // Each face's centroid, 1 / n over m faces.
+        end_row();
+      }
+
+      // Edge points, the average of the edge's vertices and face centroids:
+      for (int e = 0; e < edges; e++) {
+        int sides = (current.edge_faces[2 * e] >= 0) + (current.edge_faces[2 * e + 1] >= 0);
+        float w = 1.0f / (2 + sides);
+        add(current.edge_vertices[2 * e], w);
+        add(current.edge_vertices[2 * e + 1], w);
+        for (int k = 0; k < 2; k++) {
+          if (current.edge_faces[2 * e + k] >= 0) add_face(current.edge_faces[2 * e + k], w);
+        }
+        end_row();
+      }
+
+      // Face points, the centroid:
+      for (int f = 0; f < faces; f++) {
+        add_face(f, 1.0f);
+        end_row();
+      }
+
+      std::swap(offsets, next_offsets);
+      std::swap(indices, next_indices);
+      std::swap(weights, next_weights);
+      if (level + 1 < levels) { // The next level's topology.
+        catmull_clark(current, next);
+        std::swap(current, next);
+      }
+    }
+  }
+
+  // Compute every refined position from the base positions. Never allocates:
+  void evaluate(const al::Vec3f* control, al::Vec3f* out) const {
+    const int* offset = offsets.data();
+    const int* index = indices.data();
+    const float* weight = weights.data();
+    parallel_for(rows(), [&](int begin, int end) {
+      for (int r = begin; r < end; r++) {
+        float x = 0.0f, y = 0.0f, z = 0.0f;
+        for (int i = offset[r]; i < offset[r + 1]; i++) {
+          const al::Vec3f& p = control[index[i]];
+          x += weight[i] * p[0];
+          y += weight[i] * p[1];
+          z += weight[i] * p[2];
+        }
+        out[r] = al::Vec3f(x, y, z);
+      }
+    });
+  }
+
+  // Bytes held by the table:
+  size_t memory() const { return (offsets.capacity() + indices.capacity()) * sizeof(int) + weights.capacity() * sizeof(float); }
+};
+
+// Compare re-evaluating a deformed cube's level through stencils against subdividing it again:
+inline void benchmark_stencils(int levels = 6, int frames = 20) {
+  quad_mesh cube = create_cube(1.0f);
+  auto start = std::chrono::steady_clock::now();
+  stencil_table table;
+  table.build(cube, levels);
+  double build = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::vector<al::Vec3f> out(table.rows());
+  quad_mesh deformed = cube, refined;
+  double stencil_ms = 0.0, subdivide_ms = 0.0;
+  for (int frame = 0; frame < frames; frame++) {
+    for (int v = 0; v < cube.vertex_count(); v++) deformed.positions[v] = cube.positions[v] * (1.0f + 0.2f * std::sin(0.3f * frame + v)); // Pulse the corners.
+    build_centroids(deformed);
+    build_midpoints(deformed);
+    start = std::chrono::steady_clock::now();
+    table.evaluate(deformed.positions.data(), out.data());
+    stencil_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    refined = subdivide(deformed, levels);
+    subdivide_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+  float error = 0.0f;
+  for (int r = 0; r < table.rows(); r++) error = std::max(error, (out[r] - refined.positions[r]).mag());
+  printf("stencils to level %d: %d rows, %.2f MB, built in %.1f ms, %.3f ms per frame against %.2f ms subdividing, max difference %g\n",
+    levels, table.rows(), table.memory() / 1048576.0, build, stencil_ms / frames, subdivide_ms / frames, error);
+}